@@ -0,0 +1,58 @@
+package io.github.lizhangqu.yaml;
+
+import android.content.Context;
+import android.support.test.InstrumentationRegistry;
+import android.support.test.runner.AndroidJUnit4;
+
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+
+import static org.junit.Assert.*;
+
+/**
+ * load limits, run on an Android device against the native library
+ */
+@RunWith(AndroidJUnit4.class)
+public class YamlLimitsTest {
+
+    private File write(String name, String content) throws IOException {
+        Context appContext = InstrumentationRegistry.getTargetContext();
+        File file = new File(appContext.getCacheDir(), name);
+        FileOutputStream out = new FileOutputStream(file);
+        try {
+            out.write(content.getBytes("UTF-8"));
+        } finally {
+            out.close();
+        }
+        return file;
+    }
+
+    @Test
+    public void aliasBombExceedsMaxNodes() throws Exception {
+        // a few hundred bytes expanding to 10^9 nodes
+        StringBuilder builder = new StringBuilder("a0: &a0 [x, x, x, x, x, x, x, x, x, x]\n");
+        for (int i = 1; i <= 8; ++i) {
+            builder.append("a").append(i).append(": &a").append(i).append(" [");
+            for (int j = 0; j < 10; ++j) {
+                builder.append(j == 0 ? "" : ", ").append("*a").append(i - 1);
+            }
+            builder.append("]\n");
+        }
+        File file = write("alias_bomb.yaml", builder.toString());
+        assertEquals(0, Yaml.openDocument(file.getPath(), 10000));
+    }
+
+    @Test
+    public void aliasesCountExpanded() throws Exception {
+        // root 1, b 5, c 5, d 1 + 10
+        File file = write("aliases.yaml", "b: &b {k: [1, 2, 3]}\nc: *b\nd: [*b, *b]\n");
+        assertEquals(0, Yaml.openDocument(file.getPath(), 21));
+        long document = Yaml.openDocument(file.getPath(), 22);
+        assertNotEquals(0, document);
+        Yaml.closeDocument(document);
+    }
+}
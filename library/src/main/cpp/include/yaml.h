@@ -7,10 +7,23 @@
 #ifndef YAML_H_
 #define YAML_H_
 
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string_view>
 #include <type_traits>
 #include <common.h>
+#include <yaml_limits.h>
+#include <yaml_loader.h>
+#include <yaml_notifier.h>
+#include <yaml_sequence.h>
+#include <yaml_stats.h>
+#include <yaml_trace.h>
 
 namespace yaml {
+
+    class YamlData;
+
     // config item base class
     class YamlItem {
     public:
@@ -19,14 +32,51 @@ namespace yaml {
         };
 
         YamlItem() = default;  // null
+        YamlItem(const YamlItem &other);
+
         virtual ~YamlItem() = default;
 
         ValueType type() const { return type_; }
 
+        // content hash of the subtree, cached until a node is modified.
+        // writes through a config clear the cached hashes along their path.
+        // nodes do not know their ancestors, so modifying a node directly
+        // while its hash is cached retires the cached hashes of every node
+        // in the process
+        uint64_t hash() const;
+
+        void InvalidateHash();
+
     protected:
         YamlItem(ValueType type) : type_(type) {}
 
         ValueType type_ = kNull;
+        // the hash epoch hash_ was computed in, see CachedHash()
+        mutable std::atomic<uint32_t> hash_epoch_{0};
+        // 0 until computed
+        mutable std::atomic<uint64_t> hash_{0};
+
+        // hash_ if computed since the last modification of a hashed node,
+        // otherwise 0
+        uint64_t CachedHash() const;
+
+        // from the hashes of the children, which are cached already
+        uint64_t ComputeHash() const;
+
+        // stacks the children of item whose hash is not cached; false if
+        // there are any, to be hashed first
+        static bool PushUnhashed(const YamlItem *item, std::vector<const YamlItem *> *pending);
+
+    private:
+        friend class YamlData;
+
+        // forgets the cached hash, for writers that clear the hashes of all
+        // the ancestors as well, from the root down
+        void ClearHash() const { hash_.store(0, std::memory_order_relaxed); }
+
+        // copy-on-write token of the only document allowed to modify this
+        // node in place, see YamlData::Own()
+        uint64_t owner_ = 0;
     };
 
     class YamlValue : public YamlItem {
@@ -43,6 +93,8 @@ namespace yaml {
 
         YamlValue(const std::string &value);
 
+        YamlValue(std::string &&value);
+
         // schalar value accessors
         bool GetBool(bool *value) const;
 
@@ -68,64 +120,219 @@ namespace yaml {
         std::string value_;
     };
 
+    // read-only view of contiguous elements
+    template<class T>
+    class YamlSpan {
+    public:
+        YamlSpan() = default;
+
+        YamlSpan(const T *data, size_t size) : data_(data), size_(size) {}
+
+        const T *data() const { return data_; }
+
+        size_t size() const { return size_; }
+
+        bool empty() const { return size_ == 0; }
+
+        const T *begin() const { return data_; }
+
+        const T *end() const { return data_ + size_; }
+
+        const T &operator[](size_t i) const { return data_[i]; }
+
+    private:
+        const T *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // numbers of a list held as one typed array, see YamlList::Pack()
+    struct YamlPackedArray {
+        // one of the two is used
+        std::vector<int64_t> ints;
+        std::vector<double> doubles;
+        // digits after the decimal point of every double, as in the source
+        int decimals = 0;
+
+        size_t size() const { return ints.empty() ? doubles.size() : ints.size(); }
+
+        // the element as scalar text, the same as the source had
+        std::string Format(size_t i) const;
+
+        // stores text at i if it is a number of the same kind and format
+        bool Store(size_t i, const std::string &text);
+    };
+
     class YamlList : public YamlItem {
     public:
         using Sequence = std::vector<an<YamlItem>>;
-        using Iterator = Sequence::iterator;
+        using Iterator = YamlListIterator<an<YamlItem>>;
+        using ConstIterator = YamlListIterator<const an<YamlItem>>;
 
         YamlList() : YamlItem(kList) {}
 
+        YamlList(const YamlList &other);
+
+        ~YamlList() override;
+
+        // loaders pack numeric lists of at least this many elements
+        static const size_t kPackThreshold = 16;
+
+        // a list of at least this many elements moves into YamlChunks on the
+        // first insert or erase before its end, and back into one vector
+        // once it has shrunk to half of it
+        static const size_t kChunkThreshold = 4096;
+
         an<YamlItem> GetAt(size_t i) const;
 
         an<YamlValue> GetValueAt(size_t i) const;
 
+        // borrowed slot of the i-th element, or nullptr if out of range
+        const an<YamlItem> *FindAt(size_t i) const;
+
         bool SetAt(size_t i, an<YamlItem> element);
 
         bool Insert(size_t i, an<YamlItem> element);
 
+        // removes the i-th element; false if out of range
+        bool Erase(size_t i);
+
         bool Append(an<YamlItem> element);
 
         bool Resize(size_t size);
 
+        // room for size elements without reallocation, unless packed or
+        // held in chunks
+        void Reserve(size_t size);
+
         bool Clear();
 
         size_t size() const;
 
+        size_t capacity() const;
+
         Iterator begin();
 
         Iterator end();
 
+        ConstIterator begin() const;
+
+        ConstIterator end() const;
+
+        // converts a list of scalars that are all integers, or all decimals
+        // with the same number of fraction digits, into a packed array of
+        // 8 bytes per element. returns whether the list is packed
+        bool Pack();
+
+        // false again once the elements are materialized, see Expand()
+        bool packed() const {
+            return packed_ && !expanded_.load(std::memory_order_acquire);
+        }
+
+        // the packed elements; empty unless packed as that type
+        YamlSpan<int64_t> ints() const;
+
+        YamlSpan<double> doubles() const;
+
+        const YamlPackedArray *packed_array() const {
+            return packed() ? packed_.get() : nullptr;
+        }
+
     protected:
-        Sequence seq_;
+        // a packed list materializes elements only for readers of single
+        // elements or iterators, once. from then on the elements are the
+        // list, so writes through them are kept, and the array is only
+        // freed by the next modification of the list
+        void Expand() const;
+
+        // back to one node per element, before any other modification
+        void Unpack();
+
+        // back to one vector if the list has shrunk
+        void Fit();
+
+        mutable Sequence seq_;
+        // set instead of seq_ for large lists edited in the middle
+        the<YamlChunks> chunks_;
+        // shared by copies of the list, copied before a packed write
+        an<YamlPackedArray> packed_;
+        mutable std::atomic<bool> expanded_{false};
     };
 
 // limitation: map keys have to be strings, preferably alphanumeric
     class YamlMap : public YamlItem {
     public:
-        using Map = std::map<std::string, an<YamlItem>>;
+        // transparent comparator allows lookups by std::string_view
+        using Map = std::map<std::string, an<YamlItem>, std::less<>>;
         using Iterator = Map::iterator;
+        using ConstIterator = Map::const_iterator;
 
         YamlMap() : YamlItem(kMap) {}
 
+        ~YamlMap() override;
+
         bool HasKey(const std::string &key) const;
 
         an<YamlItem> Get(const std::string &key) const;
 
         an<YamlValue> GetValue(const std::string &key) const;
 
+        // borrowed slot of the entry, or nullptr if the key is absent
+        const an<YamlItem> *Find(std::string_view key) const;
+
         bool Set(const std::string &key, an<YamlItem> element);
 
+        bool Set(std::string &&key, an<YamlItem> element);
+
+        // adds an entry whose key sorts after every key in the map, in
+        // constant time; false, adding nothing, if the key is out of order
+        bool Append(std::string &&key, an<YamlItem> element);
+
         bool Clear();
 
+        size_t size() const;
+
         Iterator begin();
 
         Iterator end();
 
+        ConstIterator begin() const;
+
+        ConstIterator end() const;
+
     protected:
         Map map_;
     };
 
-    class YamlData;
+    template<class T>
+    struct YamlNodeTraits;
+
+    template<>
+    struct YamlNodeTraits<YamlValue> {
+        static const YamlItem::ValueType type = YamlItem::kScalar;
+    };
+
+    template<>
+    struct YamlNodeTraits<YamlList> {
+        static const YamlItem::ValueType type = YamlItem::kList;
+    };
+
+    template<>
+    struct YamlNodeTraits<YamlMap> {
+        static const YamlItem::ValueType type = YamlItem::kMap;
+    };
+
+    // checked downcast by type tag, without RTTI or reference counting
+    template<class T>
+    inline const T *Cast(const YamlItem *item) {
+        return item && item->type() == YamlNodeTraits<T>::type ?
+               static_cast<const T *>(item) : nullptr;
+    }
+
+    struct YamlFootprint;
+
+    struct YamlMatch;
+
+    class YamlSharedSegment;
 
     class YamlListEntryRef;
 
@@ -133,7 +340,9 @@ namespace yaml {
 
     class YamlItemRef {
     public:
-        YamlItemRef(const an<YamlData> &data) : data_(data) {
+        YamlItemRef(const an<YamlData> &data,
+                    const std::string &path = std::string())
+                : data_(data), path_(path) {
         }
 
         operator an<YamlItem>() const {
@@ -178,12 +387,36 @@ namespace yaml {
 
         void set_modified();
 
+        // "path/to/key" of the referenced item, as far as it is known
+        const std::string &path() const { return path_; }
+
     protected:
         virtual an<YamlItem> GetItem() const = 0;
 
         virtual void SetItem(an<YamlItem> item) = 0;
 
+        // puts item into the slot as no write of its own: a private copy of
+        // a shared node, or a new container for writes below it, which
+        // report themselves. false if the config is read-only
+        virtual bool InstallItem(an<YamlItem> item) = 0;
+
+        // drops cached paths through the node replaced by InstallItem(). a
+        // created container also marks the config modified and is
+        // journaled; a copy is not, as the writes below journal themselves
+        void Installed(bool created);
+
+        // records a SetItem() call to the write counters
+        void CountSetItem() const;
+
+        // set_modified(), journaling the node at written rather than this one
+        void MarkModified(const std::string &written);
+
+        std::string ChildPath(const std::string &key) const {
+            return path_.empty() ? key : path_ + "/" + key;
+        }
+
         an<YamlData> data_;
+        std::string path_;
     };
 
     namespace {
@@ -203,8 +436,9 @@ namespace yaml {
     class YamlListEntryRef : public YamlItemRef {
     public:
         YamlListEntryRef(an<YamlData> data,
-                           an<YamlList> list, size_t index)
-                : YamlItemRef(data), list_(list), index_(index) {
+                           an<YamlList> list, size_t index,
+                           const std::string &path = std::string())
+                : YamlItemRef(data, path), list_(list), index_(index) {
         }
 
         template<class T>
@@ -219,10 +453,15 @@ namespace yaml {
         }
 
         void SetItem(an<YamlItem> item) {
+            CountSetItem();
             list_->SetAt(index_, item);
             set_modified();
         }
 
+        bool InstallItem(an<YamlItem> item) {
+            return list_->SetAt(index_, item);
+        }
+
     private:
         an<YamlList> list_;
         size_t index_;
@@ -231,8 +470,9 @@ namespace yaml {
     class YamlMapEntryRef : public YamlItemRef {
     public:
         YamlMapEntryRef(an<YamlData> data,
-                          an<YamlMap> map, const std::string &key)
-                : YamlItemRef(data), map_(map), key_(key) {
+                          an<YamlMap> map, const std::string &key,
+                          const std::string &path = std::string())
+                : YamlItemRef(data, path), map_(map), key_(key) {
         }
 
         template<class T>
@@ -247,23 +487,50 @@ namespace yaml {
         }
 
         void SetItem(an<YamlItem> item) {
+            CountSetItem();
             map_->Set(key_, item);
             set_modified();
         }
 
+        bool InstallItem(an<YamlItem> item) {
+            return map_->Set(key_, item);
+        }
+
     private:
         an<YamlMap> map_;
         std::string key_;
     };
 
     inline YamlListEntryRef YamlItemRef::operator[](size_t index) {
-        return YamlListEntryRef(data_, AsList(), index);
+        return YamlListEntryRef(data_, AsList(), index,
+                                ChildPath("@" + std::to_string(index)));
     }
 
     inline YamlMapEntryRef YamlItemRef::operator[](const std::string &key) {
-        return YamlMapEntryRef(data_, AsMap(), key);
+        return YamlMapEntryRef(data_, AsMap(), key, ChildPath(key));
     }
 
+    // how a config is written out as YAML
+    struct YamlSaveOptions {
+        enum Style {
+            // block style, switching to flow style from flow_depth on
+            kBlock,
+            // flow style throughout
+            kFlow,
+            // one line of JSON, which YAML parsers read back as the same tree;
+            // aliases are expanded
+            kMinified
+        };
+
+        Style style = kBlock;
+        int flow_depth = 3;
+        // spaces per block level, at least 2
+        int indent = 2;
+        // no anchors or aliases, so that equal trees are written as equal
+        // bytes whichever nodes they happen to share
+        bool canonical = false;
+    };
+
 // Yaml class
 
     class Yaml : public YamlItemRef {
@@ -278,6 +545,13 @@ namespace yaml {
         // that could be reloaded by ConfigComponent once notified changes to the file
         explicit Yaml(const std::string &file_name);
 
+        // O(1) copy sharing every node with this config; nodes are copied
+        // lazily, along the path from the root to each modified node, by
+        // whichever of the two is modified. the clone has no file attached.
+        // CAVEAT: nodes obtained from GetList()/GetMap() may be shared, so
+        // modify them through SetItem() or operator[] instead
+        Yaml Clone() const;
+
         bool LoadFromStream(std::istream &stream);
 
         bool SaveToStream(std::ostream &stream);
@@ -286,6 +560,102 @@ namespace yaml {
 
         bool SaveToFile(const std::string &file_name);
 
+        // loads on a pool thread and returns at once. the first access to
+        // this config that needs the tree waits for the load to finish;
+        // the task can be waited on or canceled
+        an<YamlLoadTask> LoadFromFileAsync(const std::string &file_name,
+                                           YamlLoadCallback callback = nullptr,
+                                           YamlLoader::Priority priority = YamlLoader::kNormal);
+
+        bool SaveToStream(std::ostream &stream, const YamlSaveOptions &options);
+
+        // the options are kept for saving the file back when modified
+        bool SaveToFile(const std::string &file_name, const YamlSaveOptions &options);
+
+        // JSON input and output through a dedicated parser and writer,
+        // bypassing the YAML scanner; the tree is the same either way
+        bool LoadFromJson(std::istream &stream);
+
+        bool SaveToJson(std::ostream &stream);
+
+        bool LoadFromJsonFile(const std::string &file_name);
+
+        bool SaveToJsonFile(const std::string &file_name);
+
+        // bounds later loads of either format; a load over any limit fails,
+        // keeping the config as it was, and logs which one. max_depth also
+        // bounds saving; YAML input is nested kYamlParseDepth levels at most
+        // unless max_depth is set
+        void SetLoadLimits(const YamlLoadLimits &limits);
+
+        // later loads share one node among identical subtrees, e.g. blocks
+        // repeated by a generator; writes still affect only their own path
+        void EnableDedup(bool enabled);
+
+        // later loads store long lists of integers or fixed-point decimals
+        // as packed arrays, see YamlList::Pack()
+        void EnablePacking(bool enabled);
+
+        // writes through this class are appended to "<file>.journal" as they
+        // happen, instead of saving the whole file on commit or destruction,
+        // and loads of the file replay the journal on top of it. once the
+        // journal has grown to compact_bytes, the file is rewritten on the
+        // loader pool and the journal trimmed; 0 never compacts.
+        // CAVEAT: modifying nodes obtained from GetList()/GetMap() directly
+        // is not journaled
+        void EnableJournal(size_t compact_bytes = 1 << 20);
+
+        // folds the journal into the file, which is then saved whole again
+        void DisableJournal();
+
+        // records the paths read during window after each load of the file
+        // into "<file>.profile". if the path index is enabled and filled on
+        // lookup, the next load resolves those paths into it before it
+        // finishes; for LoadFromFileAsync() that is before the first reader
+        // is let in. elements of packed lists are left to their readers.
+        // call before loading
+        void EnableAccessProfile(std::chrono::milliseconds window = std::chrono::seconds(5));
+
+        // closes the recording window early and saves the profile
+        bool SaveAccessProfile();
+
+        // writes this config into a shared memory segment as its next
+        // generation, for other processes to attach to; see yaml_shared.h
+        bool PublishShared(const an<YamlSharedSegment> &segment);
+
+        // reads are served from the latest generation published to segment,
+        // with no parsing; only the nodes read are built, once per
+        // generation. the config is read-only until loaded again
+        bool AttachShared(const an<YamlSharedSegment> &segment);
+
+        // runtime counters of the shared config data, see YamlStats;
+        // nothing is recorded until EnableStats(true) is called
+        void GetStats(YamlStats *stats) const;
+
+        // the live counters behind GetStats(), indexed like the JNI arrays
+        const YamlStatsCounter &stats() const;
+
+        void ResetStats();
+
+        static void EnableStats(bool enabled);
+
+        static void GetGlobalStats(YamlStats *stats);
+
+        static void ResetGlobalStats();
+
+        // receives timed spans around the phases of every load and save in
+        // the process, see yaml_trace.h; nullptr stops tracing
+        static void SetTraceSink(an<YamlTraceSink> sink);
+
+        // estimated memory held by the config tree, see yaml_footprint.h.
+        // attached to a shared segment, the tree is built from it
+        void GetFootprint(YamlFootprint *footprint) const;
+
+        // appends the nodes matching a pattern with wildcards and list
+        // slices, e.g. "endpoints/*/timeout", found in a single walk; see
+        // yaml_query.h. returns false if the pattern is malformed
+        bool Query(std::string_view pattern, std::vector<YamlMatch> *matches) const;
+
         // access a tree node of a particular type with "path/to/key"
         bool IsNull(const std::string &key);
 
@@ -311,6 +681,44 @@ namespace yaml {
 
         an<YamlMap> GetMap(const std::string &key);
 
+        // zero-copy readers: no allocation and no reference counting.
+        // results borrow from the tree and are only valid until the next
+        // modification or reload of this config
+        const YamlItem *PeekItem(std::string_view key) const;
+
+        std::optional<bool> PeekBool(std::string_view key) const;
+
+        std::optional<int> PeekInt(std::string_view key) const;
+
+        std::optional<double> PeekDouble(std::string_view key) const;
+
+        std::optional<std::string_view> PeekString(std::string_view key) const;
+
+        // opt-in index from full paths to nodes, shared by all readers of
+        // this config. paths are indexed on first lookup, or all at once
+        // (and after each load) if build_now is set. writes through this
+        // class invalidate the affected paths only; after changing nodes
+        // obtained from GetList()/GetMap() directly, call InvalidatePathIndex
+        void EnablePathIndex(bool build_now = false);
+
+        void DisablePathIndex();
+
+        void InvalidatePathIndex(const std::string &prefix = "");
+
+        // calls handler with the changed paths at, below or above prefix
+        // whenever this config is written through Yaml setters, operator[]
+        // or a reload. returns an id for Unsubscribe()
+        int Subscribe(const std::string &prefix, YamlChangeHandler handler,
+                      YamlExecutor executor = nullptr);
+
+        void Unsubscribe(int subscription);
+
+        // coalesces changes up to the matching EndBatch() into one
+        // notification per subscriber; batches nest
+        void BeginBatch();
+
+        void EndBatch();
+
         // setters
         bool SetBool(const std::string &key, bool value);
 
@@ -325,6 +733,17 @@ namespace yaml {
         // setter for adding / replacing items to the tree
         bool SetItem(const std::string &key, an<YamlItem> item);
 
+        // transactions: between Begin() and Commit(), setters only stage
+        // their writes, and readers keep seeing the committed tree. Commit()
+        // applies all of them at once and saves a file-backed config once;
+        // if one fails, none is applied. entry refs (operator[]) are not
+        // staged and write through immediately
+        bool Begin();
+
+        bool Commit();
+
+        void Rollback();
+
         template<class T>
         Yaml &operator=(const T &x) {
             SetItem(AsYamlItem(x, std::is_convertible<T, an<YamlItem>>()));
@@ -332,9 +751,13 @@ namespace yaml {
         }
 
     protected:
+        explicit Yaml(const an<YamlData> &data);
+
         an<YamlItem> GetItem() const;
 
         void SetItem(an<YamlItem> item);
+
+        bool InstallItem(an<YamlItem> item);
     };
 
 }  // namespace yaml
@@ -0,0 +1,337 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_BINDING_H_
+#define YAML_BINDING_H_
+
+#include <array>
+#include <climits>
+#include <tuple>
+#include <type_traits>
+#include <yaml.h>
+
+// typed binding of config subtrees to C++ structs.
+//
+// declare the fields of a struct once:
+//
+//   namespace yaml {
+//       template<>
+//       struct YamlBinding<Endpoint> {
+//           static constexpr auto fields() {
+//               return std::make_tuple(Field("host", &Endpoint::host),
+//                                      Field("port", &Endpoint::port));
+//           }
+//       };
+//   }
+//
+// then DecodeYaml() fills an Endpoint from a map in one pass over its
+// entries, and EncodeYaml() builds the map back. supported field types are
+// bool, int, double, std::string, std::vector of those and bound structs.
+
+namespace yaml {
+
+    template<class T, class M>
+    struct YamlField {
+        const char *key;
+        M T::*member;
+    };
+
+    template<class T, class M>
+    constexpr YamlField<T, M> Field(const char *key, M T::*member) {
+        return YamlField<T, M>{key, member};
+    }
+
+    // specialized for each bound struct
+    template<class T>
+    struct YamlBinding;
+
+    struct YamlBindingError {
+        std::string path;
+        std::string message;
+    };
+
+    using YamlBindingErrors = std::vector<YamlBindingError>;
+
+    namespace binding {
+
+        const size_t kNoIndex = size_t(-1);
+
+        // location of the node being decoded; only rendered on error
+        struct Path {
+            const Path *parent;
+            std::string_view key;
+            size_t index;
+
+            std::string ToString() const {
+                std::string result = parent ? parent->ToString() : std::string();
+                if (!result.empty())
+                    result += '/';
+                if (index != kNoIndex)
+                    return result + "@" + std::to_string(index);
+                return result.append(key.data(), key.size());
+            }
+        };
+
+        inline void Report(YamlBindingErrors *errors, const Path &path,
+                           const char *message) {
+            if (errors)
+                errors->push_back(YamlBindingError{path.ToString(), message});
+        }
+
+        template<class T, class = void>
+        struct IsBound : std::false_type {
+        };
+
+        template<class T>
+        struct IsBound<T, decltype(void(YamlBinding<T>::fields()))>
+                : std::true_type {
+        };
+
+        template<class T, class = void>
+        struct Codec;
+
+        template<class T>
+        struct ScalarCodec {
+            static bool Decode(const YamlItem *item, T *out,
+                               YamlBindingErrors *errors, const Path &path,
+                               bool (YamlValue::*getter)(T *) const,
+                               const char *message) {
+                auto value = Cast<YamlValue>(item);
+                if (!value || !(value->*getter)(out)) {
+                    Report(errors, path, message);
+                    return false;
+                }
+                return true;
+            }
+
+            static an<YamlItem> Encode(const T &value) {
+                return New<YamlValue>(value);
+            }
+        };
+
+        template<>
+        struct Codec<bool> : ScalarCodec<bool> {
+            static bool Decode(const YamlItem *item, bool *out,
+                               YamlBindingErrors *errors, const Path &path) {
+                return ScalarCodec::Decode(item, out, errors, path,
+                                           &YamlValue::GetBool, "expected a bool");
+            }
+        };
+
+        template<>
+        struct Codec<int> : ScalarCodec<int> {
+            static bool Decode(const YamlItem *item, int *out,
+                               YamlBindingErrors *errors, const Path &path) {
+                return ScalarCodec::Decode(item, out, errors, path,
+                                           &YamlValue::GetInt, "expected an int");
+            }
+        };
+
+        template<>
+        struct Codec<double> : ScalarCodec<double> {
+            static bool Decode(const YamlItem *item, double *out,
+                               YamlBindingErrors *errors, const Path &path) {
+                return ScalarCodec::Decode(item, out, errors, path,
+                                           &YamlValue::GetDouble, "expected a double");
+            }
+        };
+
+        template<>
+        struct Codec<std::string> : ScalarCodec<std::string> {
+            static bool Decode(const YamlItem *item, std::string *out,
+                               YamlBindingErrors *errors, const Path &path) {
+                return ScalarCodec::Decode(item, out, errors, path,
+                                           &YamlValue::GetString, "expected a scalar");
+            }
+        };
+
+        template<class E>
+        struct Codec<std::vector<E>> {
+            static bool Decode(const YamlItem *item, std::vector<E> *out,
+                               YamlBindingErrors *errors, const Path &path) {
+                auto list = Cast<YamlList>(item);
+                if (!list) {
+                    Report(errors, path, "expected a list");
+                    return false;
+                }
+                if constexpr (std::is_same_v<E, int> || std::is_same_v<E, double>) {
+                    if (DecodePacked(list, out))
+                        return true;
+                }
+                bool ok = true;
+                out->clear();
+                out->reserve(list->size());
+                size_t i = 0;
+                for (auto it = list->begin(), end = list->end(); it != end; ++it, ++i) {
+                    Path path_to_element{&path, std::string_view(), i};
+                    E element{};
+                    ok = Codec<E>::Decode(it->get(), &element, errors, path_to_element) && ok;
+                    out->push_back(std::move(element));
+                }
+                return ok;
+            }
+
+            // reads a packed list without materializing its elements; false
+            // leaves the element-wise path to decode and report errors
+            static bool DecodePacked(const YamlList *list, std::vector<E> *out) {
+                if (!list->packed())
+                    return false;
+                auto doubles = list->doubles();
+                if (!doubles.empty()) {
+                    if constexpr (!std::is_same_v<E, double>)
+                        return false;
+                    out->assign(doubles.begin(), doubles.end());
+                    return true;
+                }
+                auto ints = list->ints();
+                for (int64_t value : ints) {
+                    if (std::is_same_v<E, int> &&
+                        (value < INT_MIN || value > INT_MAX))
+                        return false;
+                }
+                out->assign(ints.begin(), ints.end());
+                return true;
+            }
+
+            static an<YamlItem> Encode(const std::vector<E> &value) {
+                auto list = New<YamlList>();
+                list->Reserve(value.size());
+                for (const auto &element : value) {
+                    list->Append(Codec<E>::Encode(element));
+                }
+                return list;
+            }
+        };
+
+        // field keys in map order, computed at compile time
+        template<size_t N>
+        constexpr std::array<size_t, N> SortKeys(const std::array<std::string_view, N> &keys) {
+            std::array<size_t, N> order{};
+            for (size_t i = 0; i < N; ++i) {
+                order[i] = i;
+            }
+            for (size_t i = 1; i < N; ++i) {
+                for (size_t j = i; j > 0 && keys[order[j]] < keys[order[j - 1]]; --j) {
+                    size_t t = order[j];
+                    order[j] = order[j - 1];
+                    order[j - 1] = t;
+                }
+            }
+            return order;
+        }
+
+        template<class T>
+        struct FieldTable {
+            using Fields = decltype(YamlBinding<T>::fields());
+            static constexpr size_t kSize = std::tuple_size<Fields>::value;
+
+            template<size_t... I>
+            static constexpr std::array<std::string_view, kSize> Keys(std::index_sequence<I...>) {
+                return {{std::string_view(std::get<I>(YamlBinding<T>::fields()).key)...}};
+            }
+
+            static constexpr std::array<std::string_view, kSize> kKeys =
+                    Keys(std::make_index_sequence<kSize>());
+            static constexpr std::array<size_t, kSize> kOrder = SortKeys(kKeys);
+
+            template<size_t I>
+            static bool DecodeField(const YamlItem *item, T *out,
+                                    YamlBindingErrors *errors, const Path &path) {
+                constexpr auto field = std::get<I>(YamlBinding<T>::fields());
+                using M = typename std::remove_reference<decltype(out->*field.member)>::type;
+                return Codec<M>::Decode(item, &(out->*field.member), errors, path);
+            }
+
+            template<size_t I>
+            static an<YamlItem> EncodeField(const T &value) {
+                constexpr auto field = std::get<I>(YamlBinding<T>::fields());
+                using M = typename std::remove_cv<
+                        typename std::remove_reference<decltype(value.*field.member)>::type>::type;
+                return Codec<M>::Encode(value.*field.member);
+            }
+
+            using Decoder = bool (*)(const YamlItem *, T *, YamlBindingErrors *, const Path &);
+            using Encoder = an<YamlItem> (*)(const T &);
+
+            template<size_t... I>
+            static constexpr std::array<Decoder, kSize> Decoders(std::index_sequence<I...>) {
+                return {{&DecodeField<I>...}};
+            }
+
+            template<size_t... I>
+            static constexpr std::array<Encoder, kSize> Encoders(std::index_sequence<I...>) {
+                return {{&EncodeField<I>...}};
+            }
+
+            static constexpr std::array<Decoder, kSize> kDecoders =
+                    Decoders(std::make_index_sequence<kSize>());
+            static constexpr std::array<Encoder, kSize> kEncoders =
+                    Encoders(std::make_index_sequence<kSize>());
+        };
+
+        template<class T>
+        struct Codec<T, typename std::enable_if<IsBound<T>::value>::type> {
+            using Table = FieldTable<T>;
+
+            // merges the sorted map entries with the sorted field keys,
+            // visiting each entry once; absent keys keep their defaults
+            static bool Decode(const YamlItem *item, T *out,
+                               YamlBindingErrors *errors, const Path &path) {
+                auto map = Cast<YamlMap>(item);
+                if (!map) {
+                    Report(errors, path, "expected a map");
+                    return false;
+                }
+                bool ok = true;
+                size_t k = 0;
+                for (auto it = map->begin(), end = map->end();
+                     it != end && k < Table::kSize; ++it) {
+                    std::string_view key(it->first);
+                    while (k < Table::kSize && Table::kKeys[Table::kOrder[k]] < key)
+                        ++k;
+                    if (k == Table::kSize || Table::kKeys[Table::kOrder[k]] != key)
+                        continue;
+                    Path field{&path, key, kNoIndex};
+                    ok = Table::kDecoders[Table::kOrder[k]](
+                            it->second.get(), out, errors, field) && ok;
+                    ++k;
+                }
+                return ok;
+            }
+
+            static an<YamlItem> Encode(const T &value) {
+                auto map = New<YamlMap>();
+                for (size_t i = 0; i < Table::kSize; ++i) {
+                    map->Set(std::string(Table::kKeys[i]), Table::kEncoders[i](value));
+                }
+                return map;
+            }
+        };
+
+    }  // namespace binding
+
+    // decodes a config subtree into out, collecting every type error;
+    // returns true if there were none
+    template<class T>
+    bool DecodeYaml(const YamlItem *item, T *out, YamlBindingErrors *errors = nullptr) {
+        binding::Path root{nullptr, std::string_view(), binding::kNoIndex};
+        return binding::Codec<T>::Decode(item, out, errors, root);
+    }
+
+    // error paths are reported relative to the config root
+    template<class T>
+    bool DecodeYaml(const Yaml &config, std::string_view key, T *out,
+                    YamlBindingErrors *errors = nullptr) {
+        binding::Path root{nullptr, key, binding::kNoIndex};
+        return binding::Codec<T>::Decode(config.PeekItem(key), out, errors, root);
+    }
+
+    template<class T>
+    an<YamlItem> EncodeYaml(const T &value) {
+        return binding::Codec<T>::Encode(value);
+    }
+
+}  // namespace yaml
+
+#endif  // YAML_BINDING_H_
@@ -0,0 +1,80 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_BUILDER_H_
+#define YAML_BUILDER_H_
+
+#include <yaml.h>
+
+namespace yaml {
+
+    // builds a large tree in code in one pass, with no path lookups and
+    // no copies: scalars and keys are moved into their nodes, lists take
+    // their size up front, and map entries that come in key order are
+    // appended in constant time each.
+    //
+    //   YamlBuilder builder;
+    //   builder.BeginMap().Key("name").Value(std::move(name));
+    //   builder.Key("ids").BeginList(ids.size());
+    //   for (auto &id : ids)
+    //       builder.Value(std::move(id));
+    //   builder.End().End();
+    //   builder.Finish(&config);
+    //
+    // a misplaced call is logged and makes Finish() fail
+    class YamlBuilder {
+    public:
+        using Entries = std::vector<std::pair<std::string, an<YamlItem>>>;
+
+        // reserve is the expected number of elements
+        YamlBuilder &BeginList(size_t reserve = 0);
+
+        YamlBuilder &BeginMap();
+
+        // closes the innermost list or map
+        YamlBuilder &End();
+
+        // the key of the next value in a map
+        YamlBuilder &Key(std::string key);
+
+        YamlBuilder &Value(std::string value);
+
+        YamlBuilder &Null();
+
+        // a subtree built elsewhere, added as it is
+        YamlBuilder &Item(an<YamlItem> item);
+
+        // entries for the innermost map, in ascending key order
+        YamlBuilder &SortedEntries(Entries &&entries);
+
+        bool ok() const { return ok_; }
+
+        // the tree once every list and map is closed, or nullptr; the
+        // builder starts over
+        an<YamlItem> Release();
+
+        // makes the tree the whole content of config in one step
+        bool Finish(Yaml *config);
+
+    private:
+        struct Frame {
+            YamlItem *node;
+            std::string key;
+            bool has_key;
+        };
+
+        YamlBuilder &Fail(const char *message);
+
+        // adds item to the innermost container, or as the root
+        bool Add(an<YamlItem> item);
+
+        an<YamlItem> root_;
+        bool has_root_ = false;
+        std::vector<Frame> stack_;
+        bool ok_ = true;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_BUILDER_H_
@@ -0,0 +1,361 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+// 2011-04-06 Zou Xu <zouivex@gmail.com>
+//
+#ifndef YAML_DATA_H_
+#define YAML_DATA_H_
+
+#include <unordered_map>
+#include <unordered_set>
+#include <yaml.h>
+#include <yaml_index.h>
+#include <yaml_journal.h>
+#include <yaml_loader.h>
+#include <yaml_profile.h>
+#include <yaml_shared.h>
+#include <yaml_stats.h>
+#include <yaml_walk.h>
+
+namespace YAML {
+    class Emitter;
+}  // namespace YAML
+
+namespace yaml {
+
+    // map nodes resolved by the previous write of a batch, so that writes
+    // sharing a path prefix do not walk it again
+    struct YamlWriteCache {
+        std::vector<std::string> keys;
+        std::vector<an<YamlItem>> nodes;
+
+        // number of leading segments of keys[0, k) resolved already
+        size_t Match(const std::vector<std::string> &path, size_t k) const {
+            size_t i = 0;
+            while (i < k && i < keys.size() && keys[i] == path[i])
+                ++i;
+            return i;
+        }
+
+        void Truncate(size_t size) {
+            keys.resize(size);
+            nodes.resize(size);
+        }
+
+        void Clear() { Truncate(0); }
+    };
+
+    class YamlData {
+    public:
+        enum Format {
+            kYamlFormat, kJsonFormat
+        };
+
+        YamlData() = default;
+
+        ~YamlData();
+
+        bool LoadFromStream(std::istream &stream, Format format = kYamlFormat);
+
+        bool SaveToStream(std::ostream &stream, Format format = kYamlFormat);
+
+        bool SaveToStream(std::ostream &stream, Format format,
+                          const YamlSaveOptions &options);
+
+        // the file is saved back in the same format when modified
+        bool LoadFromFile(const std::string &file_name, Format format = kYamlFormat);
+
+        bool SaveToFile(const std::string &file_name, Format format = kYamlFormat);
+
+        // schedules LoadFromFile() of data on the loader pool. until it has
+        // finished, accessing the document waits for it; a newer load
+        // cancels one still pending
+        static an<YamlLoadTask> LoadFromFileAsync(const an<YamlData> &data,
+                                                  const std::string &file_name,
+                                                  Format format,
+                                                  YamlLoader::Priority priority,
+                                                  YamlLoadCallback callback);
+
+        // blocks until a pending asynchronous load has finished
+        void Await() const {
+            if (loads_pending_.load(std::memory_order_acquire))
+                WaitForLoad();
+        }
+
+        // the options are kept for saving the file back when modified
+        bool SaveToFile(const std::string &file_name, Format format,
+                        const YamlSaveOptions &options);
+
+        an<YamlItem> Traverse(const std::string &key);
+
+        // resolves a read-only path to the slot holding the node, or nullptr;
+        // walks borrowed pointers so no reference counts are touched. a node
+        // found in the index or a shared segment is copied into *hold, whose
+        // address is returned then, as their slots may go away meanwhile
+        const an<YamlItem> *FindSlot(std::string_view key, an<YamlItem> *hold) const;
+
+        bool modified() const { return modified_; }
+
+        // the changed location is unknown, so the whole path index is dropped
+        void set_modified() {
+            modified_ = true;
+            InvalidateIndex("");
+        }
+
+        // only paths at or below prefix are affected by the change
+        void set_modified(std::string_view prefix) {
+            modified_ = true;
+            InvalidateIndex(prefix);
+        }
+
+        // opt-in path index; build_now indexes the whole tree immediately and
+        // again after every load, otherwise paths are indexed on first lookup.
+        // not to be toggled while other threads are reading
+        void EnableIndex(bool build_now);
+
+        void DisableIndex();
+
+        void InvalidateIndex(std::string_view prefix) {
+            if (index_)
+                index_->InvalidatePrefix(prefix);
+        }
+
+        // for a write to key that copied shared nodes on its way, which
+        // then replace the indexed ones; the nodes below are still shared
+        void InvalidateCopiedPath(std::string_view key) {
+            if (index_)
+                index_->InvalidateAncestors(key);
+        }
+
+        // records to both this document's and the process-wide counters
+        void Count(YamlStatsCounter::Counter counter, uint64_t n = 1) const {
+            if (!YamlStatsCounter::enabled()) return;
+            stats_.Add(counter, n);
+            YamlStatsCounter::global().Add(counter, n);
+        }
+
+        // clears the cached hashes along key, from the root down to node,
+        // which is about to be modified. if node is not found there, its
+        // ancestors are unknown and it is invalidated on its own
+        void InvalidateHashes(std::string_view key, const YamlItem *node);
+
+        // sets the node at key in the tree held by *root_slot, creating
+        // intermediate nodes and copying shared ones; *copied is set if any
+        // existing node was replaced by a copy
+        bool WriteAt(an<YamlItem> *root_slot, const std::string &key,
+                     an<YamlItem> item, YamlWriteCache *cache, bool *copied);
+
+        // transactions: writes staged after Begin() are applied together by
+        // Commit(), which publishes the new tree in one step, or not at all.
+        // the writes copy their paths; if no reader still holds the previous
+        // tree, the untouched nodes are then writable in place again
+        bool Begin();
+
+        void Stage(const std::string &key, an<YamlItem> item);
+
+        bool Commit();
+
+        void Rollback();
+
+        bool in_transaction() const { return in_transaction_; }
+
+        // a document sharing the whole tree with this one
+        an<YamlData> Clone();
+
+        // copy-on-write: returns item itself if only this document may hold
+        // it, otherwise a shallow copy owned by this document. never copies
+        // before the first Clone() involving this document
+        an<YamlItem> Own(const an<YamlItem> &item) const;
+
+        bool Owns(const YamlItem *item) const {
+            return !item || item->owner_ == owner_;
+        }
+
+        // marks a node freshly created for this document
+        void Claim(YamlItem *item) const {
+            if (item)
+                item->owner_ = owner_;
+        }
+
+        // later loads hash-cons identical subtrees into one shared node, which
+        // writes then copy like nodes shared with a clone
+        void set_dedup(bool dedup) { dedup_ = dedup; }
+
+        void set_pack_numbers(bool pack_numbers) { pack_numbers_ = pack_numbers; }
+
+        // writes are appended to the journal of the file instead of saving
+        // it whole, and later loads of the file replay the journal. once
+        // the journal has compact_bytes, unless 0, the file is rewritten on
+        // the loader pool
+        void EnableJournal(size_t compact_bytes);
+
+        // saves the file if its journal has records, and removes the journal
+        void DisableJournal();
+
+        // records the nodes now at keys, as written by one setter call or
+        // transaction; does nothing unless journaling a file
+        void Journal(const std::vector<std::string> &keys);
+
+        // later loads of a file resolve the paths profiled by the previous
+        // run first, then record the paths read during window
+        void EnableAccessProfile(std::chrono::milliseconds window);
+
+        // closes the recording window and saves the profile
+        bool SaveAccessProfile();
+
+        // serves reads from the current generation of segment instead of
+        // the tree, building the nodes read once per generation; writes fail
+        // until the next load
+        void AttachShared(const an<YamlSharedSegment> &segment);
+
+        bool shared() const { return bool(shared_); }
+
+        // applies to later loads, and bounds the nesting of saved documents
+        void set_load_limits(const YamlLoadLimits &limits) { limits_ = limits; }
+
+        const YamlLoadLimits &load_limits() const { return limits_; }
+
+        YamlNotifier &notifier() { return notifier_; }
+
+        const YamlStatsCounter &stats() const { return stats_; }
+
+        YamlStatsCounter &stats() { return stats_; }
+
+        // root as last published, for readers on threads other than the
+        // writing one, which publishes with std::atomic_store()
+        an<YamlItem> root_snapshot() const { return std::atomic_load(&root); }
+
+        an<YamlItem> root;
+
+    protected:
+        bool LoadFromString(const std::string &source, Format format);
+
+        bool ReadFile(const std::string &file_name, std::string *source);
+
+        // reads at most one byte past the max_bytes limit
+        bool ReadStream(std::istream &stream, std::string *source);
+
+        bool CheckLoadBudget(size_t bytes);
+
+        void WaitForLoad() const;
+
+        // the journal of the current file, or nullptr unless journaling
+        YamlJournal *OpenJournal();
+
+        void ReplayJournal();
+
+        void ScheduleCompaction();
+
+        // drops a compaction not yet started, waits for a running one
+        void FinishCompaction();
+
+        // the profile of the current file, or nullptr unless profiling
+        YamlAccessProfile *OpenProfile();
+
+        // resolves the profiled paths into an index filled on lookup, then
+        // starts recording
+        void Preload();
+
+        const an<YamlItem> *SharedSlot(std::string_view key, an<YamlItem> *hold) const;
+
+        // tells subscribers what a reload changed
+        void NotifyReload(const an<YamlItem> &previous);
+
+        // walks from a snapshot of root, kept in *hold. unless expand, the
+        // elements of a packed list are reported missing rather than
+        // materialized
+        const an<YamlItem> *WalkSlot(std::string_view key, an<YamlItem> *hold,
+                                     bool expand = true) const;
+
+        // gives the nodes owned by token, the copies a commit made at the
+        // top of the tree, to this document
+        void Reclaim(uint64_t token);
+
+        void ResetIndex();
+
+        struct InternTable;
+
+        // returns the number of nodes in *tree replaced by an equal shared one
+        static size_t Dedup(an<YamlItem> *tree);
+
+        static void Intern(an<YamlItem> *root, InternTable *table, size_t *replaced);
+
+        static void Share(YamlItem *item, uint64_t owner);
+
+        struct EmitAnchor {
+            std::string name;
+            bool emitted = false;
+        };
+
+        struct EmitContext {
+            // nodes to be written as anchors and aliases
+            std::unordered_map<const YamlItem *, EmitAnchor> nodes;
+            std::unordered_set<std::string> used;
+            int next_id = 0;
+            // lists and maps from this depth on are written in flow style
+            int flow_depth = 3;
+            // nodes written so far, aliases included
+            size_t emitted = 0;
+        };
+
+        // picks the nodes reached more than once to be written as anchors
+        void CollectAnchors(const YamlItem *root, EmitContext *context) const;
+
+        class EmitVisitor;
+
+        void EmitYaml(const an<YamlItem> &root,
+                      YAML::Emitter *emitter,
+                      EmitContext *context) const;
+
+        bool WriteJson(std::ostream &stream);
+
+        static void EmitScalar(const std::string &str_value,
+                               YAML::Emitter *emitter);
+
+        std::string file_name_;
+        Format format_ = kYamlFormat;
+        YamlLoadLimits limits_;
+        YamlSaveOptions save_options_;
+        // asynchronous loads scheduled and not yet finished
+        std::atomic<int> loads_pending_{0};
+        // the latest asynchronous load, replaced by the scheduling thread
+        // while readers wait on it
+        an<YamlLoadTask> load_task_;
+        mutable std::mutex load_task_mutex_;
+        // set while a load runs on behalf of a YamlLoadTask
+        const std::atomic<bool> *cancel_ = nullptr;
+        bool modified_ = false;
+        // 0 until the tree is first shared with a clone
+        uint64_t owner_ = 0;
+        bool in_transaction_ = false;
+        std::vector<std::pair<std::string, an<YamlItem>>> staged_;
+        mutable YamlStatsCounter stats_;
+        the<YamlPathIndex> index_;
+        YamlNotifier notifier_;
+        bool build_index_ = false;
+        bool dedup_ = false;
+        bool pack_numbers_ = false;
+        bool journal_enabled_ = false;
+        size_t compact_bytes_ = 0;
+        an<YamlJournal> journal_;
+        an<YamlLoadTask> compaction_;
+        // set if writes are missing from the journal, which the file then
+        // has to be saved whole for
+        bool journal_lost_ = false;
+        bool profiling_ = false;
+        std::chrono::milliseconds profile_window_{0};
+        an<YamlAccessProfile> profile_;
+        an<YamlSharedSegment> shared_;
+        // nodes built from the shared segment, by path; dropped like a
+        // reloaded tree once a new generation is published
+        mutable std::mutex shared_mutex_;
+        mutable uint64_t shared_generation_ = 0;
+        mutable std::unordered_map<std::string, an<YamlItem>> shared_nodes_;
+        // anchor names of the loaded source, by node
+        std::unordered_map<const YamlItem *, std::string> anchor_names_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_DATA_H_
@@ -0,0 +1,36 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_DIFF_H_
+#define YAML_DIFF_H_
+
+#include <yaml.h>
+
+namespace yaml {
+
+    // paths use the same "key/@index" syntax as Yaml getters
+    struct YamlDiff {
+        std::vector<std::string> added;
+        std::vector<std::string> removed;
+        // replaced scalars, or nodes whose type changed
+        std::vector<std::string> changed;
+
+        bool empty() const {
+            return added.empty() && removed.empty() && changed.empty();
+        }
+    };
+
+    // structural diff between two trees. subtrees that are shared or have
+    // equal content hashes are skipped without being visited, so the cost
+    // follows the size of the change rather than the size of the trees.
+    // map entries holding null are treated as absent. lists are compared by
+    // index after skipping their common head and tail, so one insertion or
+    // removal shows as that, not as every later element changed
+    void DiffYaml(const YamlItem *from, const YamlItem *to, YamlDiff *diff);
+
+    void DiffYaml(const Yaml &from, const Yaml &to, YamlDiff *diff);
+
+}  // namespace yaml
+
+#endif  // YAML_DIFF_H_
@@ -0,0 +1,43 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_FOOTPRINT_H_
+#define YAML_FOOTPRINT_H_
+
+#include <yaml.h>
+
+namespace yaml {
+
+    // estimated heap usage of a config tree, in bytes.
+    // figures are approximations based on the layout of the standard library
+    // containers and shared_ptr control blocks created by New<T>().
+    struct YamlFootprint {
+        size_t total_bytes = 0;
+        // indexed by YamlItem::ValueType; a node's bytes include its own
+        // object, control block and payload, but not its children
+        size_t nodes[4] = {0, 0, 0, 0};
+        size_t bytes[4] = {0, 0, 0, 0};
+        // breakdown of total_bytes
+        size_t control_block_bytes = 0;
+        size_t string_bytes = 0;
+        size_t map_entry_bytes = 0;
+        size_t list_buffer_bytes = 0;
+        // overheads, already included above
+        size_t string_slack_bytes = 0;
+        size_t list_slack_bytes = 0;
+        // scalar values and map keys seen more than once;
+        // bytes that interning would save
+        size_t duplicate_strings = 0;
+        size_t duplicate_string_bytes = 0;
+        // nodes reachable through more than one parent, counted once
+        size_t shared_nodes = 0;
+        // subtree size under each key of a map root
+        std::map<std::string, size_t> top_level_bytes;
+    };
+
+    void MeasureFootprint(const an<YamlItem> &root, YamlFootprint *footprint);
+
+}  // namespace yaml
+
+#endif  // YAML_FOOTPRINT_H_
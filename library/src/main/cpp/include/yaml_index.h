@@ -0,0 +1,61 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_INDEX_H_
+#define YAML_INDEX_H_
+
+#include <map>
+#include <shared_mutex>
+#include <string_view>
+#include <yaml.h>
+
+namespace yaml {
+
+    // maps full "path/to/key" strings to the nodes they resolve to, so that
+    // a hot lookup costs one hash probe instead of one map lookup per level.
+    // the paths are also kept in order, so that the entries below a prefix
+    // are dropped as one range. entries hold a reference to their node; a
+    // mutation that bypasses Yaml/YamlItemRef must be followed by an
+    // explicit invalidation.
+    class YamlPathIndex {
+    public:
+        static size_t Hash(std::string_view path) {
+            return std::hash<std::string_view>()(path);
+        }
+
+        // returns the indexed node, or nullptr on a miss. the reference is
+        // taken under the lock, so a concurrent invalidation cannot free it
+        an<YamlItem> Find(std::string_view path, size_t hash) const;
+
+        void Insert(std::string_view path, size_t hash, const an<YamlItem> &item);
+
+        // drops the entry for prefix and every path below it;
+        // an empty prefix drops everything
+        void InvalidatePrefix(std::string_view prefix);
+
+        // drops the entries for the ancestors of path only, e.g. after they
+        // were replaced by copies, which share the nodes below them
+        void InvalidateAncestors(std::string_view path);
+
+        void Clear();
+
+        // indexes every node reachable from root
+        void Build(const an<YamlItem> &root);
+
+        size_t size() const;
+
+    private:
+        using Paths = std::map<std::string, an<YamlItem>, std::less<>>;
+
+        void Erase(Paths::iterator it);
+
+        mutable std::shared_mutex mutex_;
+        Paths paths_;
+        // the entries of paths_ by the hash of their path
+        std::unordered_multimap<size_t, Paths::iterator> buckets_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_INDEX_H_
@@ -0,0 +1,61 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_JOURNAL_H_
+#define YAML_JOURNAL_H_
+
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <yaml.h>
+
+namespace yaml {
+
+    // append-only log of the writes to a config file, kept next to it as
+    // "<file>.journal". each record is one line of JSON, [path, value, ...],
+    // holding the writes of one setter call or transaction. records set
+    // absolute paths, so replaying one that the file already holds is harmless
+    class YamlJournal {
+    public:
+        using Writes = std::vector<std::pair<std::string, an<YamlItem>>>;
+
+        explicit YamlJournal(const std::string &file_name);
+
+        // the config file this journal belongs to
+        const std::string &file_name() const { return file_name_; }
+
+        // bytes of records not yet folded into the file
+        size_t size() const;
+
+        // writes one record; returns false if it could not be written
+        bool Append(const Writes &writes);
+
+        // calls apply with every write of every complete record, in order.
+        // a torn or malformed record ends the journal and is cut off, so
+        // that later records are not appended to it. returns the records read
+        size_t Replay(const std::function<void(const std::string &path,
+                                               an<YamlItem> item)> &apply,
+                      bool pack_numbers);
+
+        // drops every record, once the file has been saved whole
+        bool Reset();
+
+        // replaces the file with what save writes, then drops the records
+        // up to offset, which save is known to include; records appended in
+        // the meantime are kept. may run on another thread than Append()
+        bool Compact(size_t offset, const std::function<bool(std::ostream &out)> &save);
+
+    private:
+        bool OpenForAppend();
+
+        std::string file_name_;
+        std::string path_;
+        mutable std::mutex mutex_;
+        std::ofstream out_;
+        size_t size_ = 0;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_JOURNAL_H_
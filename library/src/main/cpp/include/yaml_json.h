@@ -0,0 +1,90 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_JSON_H_
+#define YAML_JSON_H_
+
+#include <string_view>
+#include <yaml.h>
+#include <yaml_walk.h>
+
+namespace yaml {
+
+    // dedicated JSON reader building the same tree as the YAML loader:
+    // strings, numbers and booleans become YamlValue holding their text,
+    // null becomes an empty slot. single pass, no intermediate DOM
+    class YamlJsonReader {
+    public:
+        // returns false and sets error on malformed input, or when the
+        // optional budget is exceeded
+        bool Parse(std::string_view source, an<YamlItem> *root, std::string *error,
+                   YamlLoadBudget *budget = nullptr);
+
+        // long lists of numbers are packed as they are closed
+        void set_pack_numbers(bool pack_numbers) { pack_numbers_ = pack_numbers; }
+
+        // nodes created by the last Parse(), indexed by YamlItem::ValueType
+        size_t node_count(YamlItem::ValueType type) const { return nodes_[type]; }
+
+    private:
+        bool ParseString(std::string *out);
+
+        bool ParseScalar(an<YamlItem> *out);
+
+        void SkipSpace();
+
+        bool Fail(const char *message);
+
+        bool Enter(size_t depth);
+
+        const char *begin_ = nullptr;
+        const char *p_ = nullptr;
+        const char *end_ = nullptr;
+        std::string *error_ = nullptr;
+        YamlLoadBudget *budget_ = nullptr;
+        bool pack_numbers_ = false;
+        size_t nodes_[4] = {0, 0, 0, 0};
+    };
+
+    // writes a tree as compact JSON. scalars that read as JSON numbers or
+    // booleans are written bare, other scalars as strings; null map entries
+    // are skipped as in YAML output
+    class YamlJsonWriter : private YamlVisitor {
+    public:
+        // returns false if the tree nests deeper than max_depth, unless 0
+        bool Write(const YamlItem *root, std::string *out, size_t max_depth = 0);
+
+        // nodes written by the last Write()
+        size_t node_count() const { return nodes_; }
+
+        // appends str as a quoted, escaped JSON string
+        static void WriteString(std::string_view str, std::string *out);
+
+    private:
+        // the separator and key in front of a value
+        bool Prefix(const YamlWalkStep &step);
+
+        void VisitNull(const YamlWalkStep &step) override;
+
+        void VisitScalar(const YamlWalkStep &step, const YamlValue &value) override;
+
+        bool BeginList(const YamlWalkStep &step, const YamlList &list) override;
+
+        void EndList(const YamlWalkStep &step, const YamlList &list) override;
+
+        bool BeginMap(const YamlWalkStep &step, const YamlMap &map) override;
+
+        void EndMap(const YamlWalkStep &step, const YamlMap &map) override;
+
+        static bool IsBareScalar(std::string_view str);
+
+        std::string *out_ = nullptr;
+        // no value has been written yet into the innermost list or map
+        bool first_ = true;
+        size_t nodes_ = 0;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_JSON_H_
@@ -0,0 +1,104 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_LIMITS_H_
+#define YAML_LIMITS_H_
+
+#include <atomic>
+#include <chrono>
+#include <common.h>
+
+namespace yaml {
+
+    // bounds on the input a load may consume; 0 means unlimited
+    struct YamlLoadLimits {
+        size_t max_bytes = 0;
+        // nesting depth of lists and maps, also enforced when saving
+        size_t max_depth = 0;
+        // counted as if aliases were expanded, each repeating the nodes of
+        // its anchor, as walks over the tree will
+        size_t max_nodes = 0;
+        size_t max_scalar_length = 0;
+        // wall-clock budget for parsing and building the tree
+        std::chrono::milliseconds timeout{0};
+    };
+
+    // nesting depth YAML input is held to when max_depth is 0. yaml-cpp
+    // parses it by recursive descent, a few native frames per level, so
+    // deeper documents could overflow the stack of a loading thread. JSON
+    // input is read without recursion and has no such bound
+    const size_t kYamlParseDepth = 256;
+
+    // tracks one load against its limits; the first violation is recorded
+    // and every later check fails, so loaders can bail out at once
+    class YamlLoadBudget {
+    public:
+        explicit YamlLoadBudget(const YamlLoadLimits &limits)
+                : limits_(limits), start_(std::chrono::steady_clock::now()) {
+        }
+
+        bool CheckBytes(size_t bytes) {
+            if (limits_.max_bytes && bytes > limits_.max_bytes)
+                return Exceed("input exceeds max_bytes");
+            return ok();
+        }
+
+        // counts nodes at the given depth, the root being at depth 0; an
+        // alias counts as the nodes it repeats
+        bool EnterNode(size_t depth, size_t nodes = 1) {
+            if (limits_.max_depth && depth > limits_.max_depth)
+                return Exceed("document exceeds max_depth");
+            if (limits_.max_nodes && nodes > limits_.max_nodes - nodes_)
+                return Exceed("document exceeds max_nodes");
+            nodes_ += nodes;
+            // reading the clock is not free, sample it
+            if ((limits_.timeout.count() || cancel_) && (++ticks_ & 0xff) == 0)
+                return CheckDeadline() && CheckCanceled();
+            return ok();
+        }
+
+        bool CheckScalar(size_t length) {
+            if (limits_.max_scalar_length && length > limits_.max_scalar_length)
+                return Exceed("scalar exceeds max_scalar_length");
+            return ok();
+        }
+
+        bool CheckDeadline() {
+            if (limits_.timeout.count() &&
+                std::chrono::steady_clock::now() - start_ > limits_.timeout)
+                return Exceed("load exceeds timeout");
+            return ok();
+        }
+
+        // the load stops once flag is set, e.g. by YamlLoadTask::Cancel()
+        void set_cancel_flag(const std::atomic<bool> *flag) { cancel_ = flag; }
+
+        bool CheckCanceled() {
+            if (cancel_ && cancel_->load(std::memory_order_relaxed))
+                return Exceed("load canceled");
+            return ok();
+        }
+
+        bool ok() const { return error_.empty(); }
+
+        const std::string &error() const { return error_; }
+
+    private:
+        bool Exceed(const char *message) {
+            if (error_.empty())
+                error_ = message;
+            return false;
+        }
+
+        const YamlLoadLimits &limits_;
+        std::chrono::steady_clock::time_point start_;
+        size_t nodes_ = 0;
+        size_t ticks_ = 0;
+        const std::atomic<bool> *cancel_ = nullptr;
+        std::string error_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_LIMITS_H_
@@ -0,0 +1,106 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_LOADER_H_
+#define YAML_LOADER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <common.h>
+
+namespace yaml {
+
+    // receives the result of an asynchronous load, on a loader thread;
+    // a load canceled before it started reports false
+    using YamlLoadCallback = std::function<void(bool success)>;
+
+    // a load scheduled on the loader pool
+    class YamlLoadTask {
+    public:
+        enum State {
+            kPending, kRunning, kDone, kCanceled
+        };
+
+        YamlLoadTask();
+
+        // a pending load is dropped; a running one stops at its next check
+        // and fails. returns false if the load had finished already
+        bool Cancel();
+
+        // blocks until the load has finished or was canceled
+        bool Wait() const { return future_.get(); }
+
+        std::shared_future<bool> future() const { return future_; }
+
+        State state() const { return state_.load(std::memory_order_acquire); }
+
+        // polled by the running load
+        const std::atomic<bool> *cancel_flag() const { return &canceled_; }
+
+    private:
+        friend class YamlLoader;
+
+        // false if canceled before it started
+        bool Start();
+
+        void Finish(bool success);
+
+        std::atomic<State> state_{kPending};
+        std::atomic<bool> canceled_{false};
+        std::promise<bool> promise_;
+        std::shared_future<bool> future_;
+    };
+
+    // small process-wide pool running loads off the calling thread
+    class YamlLoader {
+    public:
+        enum Priority {
+            kLow, kNormal, kHigh
+        };
+
+        static YamlLoader &instance();
+
+        ~YamlLoader();
+
+        // runs job on a pool thread; queued jobs of higher priority start
+        // first, jobs of equal priority in order of scheduling. job receives
+        // the task so it can observe cancellation
+        an<YamlLoadTask> Schedule(std::function<bool(const YamlLoadTask &task)> job,
+                                  Priority priority,
+                                  YamlLoadCallback callback = nullptr);
+
+    private:
+        struct Job {
+            int priority;
+            uint64_t seq;
+            an<YamlLoadTask> task;
+            std::function<bool(const YamlLoadTask &task)> run;
+            YamlLoadCallback callback;
+
+            bool operator<(const Job &other) const {
+                // std::priority_queue pops the greatest
+                return priority != other.priority ? priority < other.priority
+                                                  : seq > other.seq;
+            }
+        };
+
+        YamlLoader();
+
+        void Work();
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::priority_queue<Job> queue_;
+        std::vector<std::thread> threads_;
+        uint64_t next_seq_ = 0;
+        bool stopping_ = false;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_LOADER_H_
@@ -0,0 +1,65 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_NOTIFIER_H_
+#define YAML_NOTIFIER_H_
+
+#include <atomic>
+#include <mutex>
+#include <string_view>
+#include <common.h>
+
+namespace yaml {
+
+    // receives the changed paths relevant to a subscription, once per batch
+    using YamlChangeHandler = std::function<void(const std::vector<std::string> &paths)>;
+
+    // runs a notification task; an empty executor runs it on the writing thread
+    using YamlExecutor = std::function<void(std::function<void()> task)>;
+
+    // path-scoped change subscriptions of a config document
+    class YamlNotifier {
+    public:
+        // a subscription to prefix is notified of changes at, below or above
+        // prefix; an empty prefix subscribes to the whole document
+        int Subscribe(const std::string &prefix, YamlChangeHandler handler,
+                      YamlExecutor executor);
+
+        void Unsubscribe(int id);
+
+        bool has_subscribers() const {
+            return count_.load(std::memory_order_relaxed) != 0;
+        }
+
+        void Notify(std::string_view path);
+
+        void Notify(const std::vector<std::string> &paths);
+
+        // changes made between the outermost BeginBatch() and EndBatch()
+        // are coalesced into one notification per subscriber
+        void BeginBatch();
+
+        void EndBatch();
+
+    private:
+        struct Subscription {
+            int id;
+            std::string prefix;
+            YamlChangeHandler handler;
+            YamlExecutor executor;
+        };
+
+        void Deliver(const std::vector<std::string> &paths);
+
+        std::mutex mutex_;
+        std::vector<Subscription> subscriptions_;
+        std::atomic<size_t> count_{0};
+        int next_id_ = 0;
+        int batch_depth_ = 0;
+        std::vector<std::string> pending_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_NOTIFIER_H_
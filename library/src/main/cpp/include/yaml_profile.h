@@ -0,0 +1,60 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_PROFILE_H_
+#define YAML_PROFILE_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string_view>
+#include <common.h>
+
+namespace yaml {
+
+    // the paths read from a config during a window after it was loaded,
+    // kept next to the file as "<file>.profile", one path per line in order
+    // of first access. the next load of the file resolves them first
+    class YamlAccessProfile {
+    public:
+        // paths beyond this many are not recorded
+        static const size_t kMaxPaths = 4096;
+
+        YamlAccessProfile(const std::string &file_name, std::chrono::milliseconds window);
+
+        const std::string &file_name() const { return file_name_; }
+
+        // the paths recorded by a previous run, or false if there are none
+        bool Load(std::vector<std::string> *paths) const;
+
+        // opens a new recording window, dropping what was recorded before;
+        // a window of 0 stays open until Stop()
+        void Start();
+
+        // records a path resolved by a reader; the first call after the
+        // window has closed saves the profile. a single relaxed load once
+        // recording has stopped
+        void Record(std::string_view path);
+
+        // closes the window early and saves what was recorded
+        bool Stop();
+
+        bool recording() const { return recording_.load(std::memory_order_relaxed); }
+
+    private:
+        bool Save();
+
+        std::string file_name_;
+        std::string path_;
+        std::chrono::milliseconds window_;
+        std::chrono::steady_clock::time_point deadline_;
+        std::atomic<bool> recording_{false};
+        std::mutex mutex_;
+        std::vector<std::string> paths_;
+        std::unordered_set<std::string> seen_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_PROFILE_H_
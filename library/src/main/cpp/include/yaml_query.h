@@ -0,0 +1,91 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_QUERY_H_
+#define YAML_QUERY_H_
+
+#include <string_view>
+#include <yaml.h>
+
+namespace yaml {
+
+    // a node found by a query; the pointer is borrowed from the tree and
+    // valid until the next write
+    struct YamlMatch {
+        std::string path;
+        const YamlItem *item;
+    };
+
+    // a compiled path pattern. segments are separated by '/' and may be
+    //   key          a map key
+    //   @N, @last    a list element
+    //   @N..@M       list elements N through M, either end may be omitted
+    //   *            any map value or list element
+    //   **           any number of levels, including none
+    // all matches are collected in one walk of the tree, in document order;
+    // each node is reported once and null nodes are not reported
+    class YamlQuery {
+    public:
+        // returns false if the pattern is malformed
+        bool Parse(std::string_view pattern);
+
+        void Run(const YamlItem *root, std::vector<YamlMatch> *matches) const;
+
+    private:
+        struct Segment {
+            enum Kind {
+                kKey, kRange, kAny, kDescendants
+            };
+            Kind kind;
+            std::string key;
+            // inclusive; kLast stands for the last element
+            size_t first;
+            size_t last;
+        };
+
+        static const size_t kLast = size_t(-1);
+
+        // indices into segments_ still to be matched
+        using States = std::vector<size_t>;
+
+        // a list or map whose children are being matched
+        struct Frame {
+            const YamlList *list = nullptr;
+            const YamlMap *map = nullptr;
+            States states;
+            size_t path_length = 0;
+            // list elements from next up to last, or the next of keys
+            size_t size = 0;
+            size_t next = 0;
+            size_t last = 0;
+            // keys looked up in a map rather than scanned
+            bool direct = false;
+            std::vector<const std::string *> keys;
+            YamlMap::ConstIterator entry;
+        };
+
+        // reports item if it matches, and stacks it to walk its children;
+        // the walk keeps deep trees off the native stack
+        void Enter(const YamlItem *item, States &&states, const std::string *path,
+                   std::vector<Frame> *stack, std::vector<YamlMatch> *matches) const;
+
+        // the next child of frame worth stepping to
+        bool Next(Frame *frame, const YamlItem **child, const std::string **key,
+                  size_t *index) const;
+
+        // adds the states reached by stepping to a child, by key or by index
+        void Step(const States &states, const std::string *key, size_t index,
+                  size_t list_size, States *next) const;
+
+        // follows '**' matching no level
+        void Close(States *states) const;
+
+        bool IsDirect(const States &states) const;
+
+        std::vector<Segment> segments_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_QUERY_H_
@@ -0,0 +1,162 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_SEQUENCE_H_
+#define YAML_SEQUENCE_H_
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <common.h>
+
+namespace yaml {
+
+    class YamlItem;
+
+    // elements of a large list, held in chunks with a Fenwick tree over the
+    // chunk sizes. a chunk is split in halves once inserts have grown it to
+    // 2 * kChunkSize elements, the new half taking an empty slot next to
+    // it; a chunk that erases shrink below kChunkSize / 2 is merged into a
+    // neighbour, or refilled from it, leaving its slot empty. the slots are
+    // spread out again only when a split finds no empty one nearby, or
+    // empty ones outnumber the chunks, so locating, inserting or erasing an
+    // element costs O(log chunks) amortized plus a shift within one chunk
+    class YamlChunks {
+    public:
+        using Chunk = std::vector<an<YamlItem>>;
+
+        // chunks are filled to this size by appends
+        static const size_t kChunkSize = 512;
+
+        explicit YamlChunks(std::vector<an<YamlItem>> &&elements);
+
+        size_t size() const { return size_; }
+
+        size_t capacity() const;
+
+        // i < size()
+        an<YamlItem> &at(size_t i);
+
+        const an<YamlItem> &at(size_t i) const;
+
+        // i <= size()
+        void Insert(size_t i, an<YamlItem> element);
+
+        // i < size()
+        void Erase(size_t i);
+
+        void Append(an<YamlItem> element);
+
+        // pads with empty slots or truncates
+        void Resize(size_t size);
+
+        // moves all elements into one vector, leaving this empty
+        std::vector<an<YamlItem>> Flatten();
+
+        // in order, some of them possibly empty
+        const std::vector<Chunk> &chunks() const { return chunks_; }
+
+        std::vector<Chunk> &chunks() { return chunks_; }
+
+    private:
+        // the chunk holding element i, and the offset of i within it
+        size_t Locate(size_t i, size_t *offset) const;
+
+        // number of elements in the chunks before chunk
+        size_t Prefix(size_t chunk) const;
+
+        void Add(size_t chunk, std::ptrdiff_t delta);
+
+        // appends a chunk, extending the tree by one node
+        void Push(Chunk &&chunk);
+
+        // moves half of the elements of full chunk k into an empty slot
+        void Split(size_t k);
+
+        // merges or refills chunk k, which has shrunk below kChunkSize / 2
+        void Rebalance(size_t k);
+
+        // moves count elements from the end of chunk from to the start of
+        // chunk to, or the other way round if to comes first
+        void Move(size_t from, size_t to, size_t count);
+
+        // drops the empty slots, then puts one after every chunk; returns
+        // where chunk k is now
+        size_t Spread(size_t k);
+
+        void Rebuild();
+
+        std::vector<Chunk> chunks_;
+        // 1-based Fenwick tree of chunk sizes
+        std::vector<size_t> tree_;
+        size_t size_ = 0;
+        // number of empty chunks
+        size_t gaps_ = 0;
+    };
+
+    // forward iterator over the elements of a list, whether they are held in
+    // one vector or in chunks; T is an<YamlItem>, optionally const
+    template<class T>
+    class YamlListIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = an<YamlItem>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+        using Chunk = typename std::conditional<std::is_const<T>::value,
+                const YamlChunks::Chunk, YamlChunks::Chunk>::type;
+
+        YamlListIterator() = default;
+
+        // over one contiguous run
+        explicit YamlListIterator(T *p) : p_(p), end_(p) {}
+
+        // at offset of chunk, with last the final chunk
+        YamlListIterator(Chunk *chunk, Chunk *last, size_t offset)
+                : p_(chunk->data() + offset), end_(chunk->data() + chunk->size()),
+                  chunk_(chunk), last_(last) {
+            Skip();
+        }
+
+        reference operator*() const { return *p_; }
+
+        pointer operator->() const { return p_; }
+
+        YamlListIterator &operator++() {
+            ++p_;
+            Skip();
+            return *this;
+        }
+
+        YamlListIterator operator++(int) {
+            YamlListIterator previous(*this);
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const YamlListIterator &other) const { return p_ == other.p_; }
+
+        bool operator!=(const YamlListIterator &other) const { return p_ != other.p_; }
+
+    private:
+        // from the end of a chunk on to the next element, over empty chunks;
+        // only the end of the last chunk is a position of its own
+        void Skip() {
+            while (p_ == end_ && chunk_ != last_) {
+                ++chunk_;
+                p_ = chunk_->data();
+                end_ = p_ + chunk_->size();
+            }
+        }
+
+        T *p_ = nullptr;
+        T *end_ = nullptr;
+        Chunk *chunk_ = nullptr;
+        Chunk *last_ = nullptr;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_SEQUENCE_H_
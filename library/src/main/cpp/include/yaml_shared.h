@@ -0,0 +1,77 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_SHARED_H_
+#define YAML_SHARED_H_
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <yaml.h>
+
+namespace yaml {
+
+    // a config tree published by one process into a memfd, for other
+    // processes on the host to read without parsing it.
+    //
+    // the segment holds a header and two slots. each slot is a read-only,
+    // position-independent image of a tree: nodes refer to each other and to
+    // their text by offsets from the start of the slot, map entries are
+    // sorted for binary search. Publish() writes the image to the slot not
+    // in use and then flips the generation, so readers keep reading the
+    // previous generation meanwhile. a reader copies out what it reads and
+    // retries if the slot was overwritten under it, seqlock style.
+    //
+    // the fd is handed to other processes by the application, e.g. over a
+    // unix socket or as a ParcelFileDescriptor on Android
+    class YamlSharedSegment {
+    public:
+        ~YamlSharedSegment();
+
+        // creates an empty segment to publish into; nullptr on failure
+        static an<YamlSharedSegment> Create(const std::string &name);
+
+        // maps a segment created by another process, read-only. fd is
+        // duplicated, the caller keeps its own
+        static an<YamlSharedSegment> Attach(int fd);
+
+        int fd() const { return fd_; }
+
+        // bumped by every Publish(); 0 until the first one
+        uint64_t generation() const;
+
+        // writes root as the next generation; publisher only
+        bool Publish(const YamlItem *root);
+
+        // builds the node at a "path/to/key" of the current generation, or
+        // of the whole tree for an empty path. returns false if there is no
+        // such node, or the segment is corrupt
+        bool Read(std::string_view path, an<YamlItem> *item, uint64_t *generation);
+
+        // flat image of a tree, as stored in a slot
+        static void Encode(const YamlItem *root, std::string *image);
+
+    private:
+        struct Header;
+
+        YamlSharedSegment(int fd, bool writable);
+
+        bool Map(size_t size);
+
+        Header *header() const;
+
+        int fd_ = -1;
+        bool writable_ = false;
+        char *base_ = nullptr;
+        size_t mapped_ = 0;
+        // readers hold it shared while reading a slot, remapping takes it
+        // exclusively
+        mutable std::shared_mutex map_mutex_;
+        std::mutex publish_mutex_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_SHARED_H_
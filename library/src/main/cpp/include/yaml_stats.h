@@ -0,0 +1,83 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_STATS_H_
+#define YAML_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <common.h>
+
+namespace yaml {
+
+    // plain snapshot of runtime counters, safe to copy around
+    struct YamlStats {
+        uint64_t loads = 0;
+        uint64_t load_failures = 0;
+        uint64_t parse_time_us = 0;
+        uint64_t bytes_parsed = 0;
+        // indexed by YamlItem::ValueType
+        uint64_t nodes[4] = {0, 0, 0, 0};
+        uint64_t traversals = 0;
+        uint64_t path_cache_hits = 0;
+        uint64_t failed_lookups = 0;
+        uint64_t set_item_calls = 0;
+        uint64_t saves = 0;
+    };
+
+    // lock-free counters; recording is a no-op unless enabled process-wide
+    class YamlStatsCounter {
+    public:
+        // the order is part of the JNI contract, see Yaml.java
+        enum Counter {
+            kLoads,
+            kLoadFailures,
+            kParseTimeUs,
+            kBytesParsed,
+            kNullNodes,
+            kScalarNodes,
+            kListNodes,
+            kMapNodes,
+            kTraversals,
+            kPathCacheHits,
+            kFailedLookups,
+            kSetItemCalls,
+            kSaves,
+            kNumCounters
+        };
+
+        YamlStatsCounter();
+
+        static bool enabled() {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        static void set_enabled(bool enabled) {
+            enabled_.store(enabled, std::memory_order_relaxed);
+        }
+
+        // process-wide totals
+        static YamlStatsCounter &global();
+
+        void Add(Counter counter, uint64_t n = 1) {
+            counters_[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t Get(Counter counter) const {
+            return counters_[counter].load(std::memory_order_relaxed);
+        }
+
+        void Snapshot(YamlStats *stats) const;
+
+        void Reset();
+
+    private:
+        static std::atomic<bool> enabled_;
+
+        std::atomic<uint64_t> counters_[kNumCounters];
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_STATS_H_
@@ -0,0 +1,110 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_TRACE_H_
+#define YAML_TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <common.h>
+
+namespace yaml {
+
+    // a timed phase of loading or saving a config
+    struct YamlTraceSpan {
+        // "load", "read", "parse", "replay", "preload", "save", "emit" or
+        // "write"
+        const char *name = nullptr;
+        // the config file, empty for streams and strings
+        std::string_view file_name;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::duration duration{};
+        // bytes read, parsed or written, 0 if not known
+        uint64_t bytes = 0;
+        // nodes built or written, 0 if not known
+        uint64_t nodes = 0;
+    };
+
+    // receives each span as it ends, on the thread that ran it, so
+    // enclosing spans end after the ones they contain
+    class YamlTraceSink {
+    public:
+        virtual ~YamlTraceSink() = default;
+
+        virtual void Record(const YamlTraceSpan &span) = 0;
+    };
+
+    class YamlTracer {
+    public:
+        static bool enabled() {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        // installs a process-wide sink, or stops tracing with nullptr
+        static void set_sink(an<YamlTraceSink> sink);
+
+        static an<YamlTraceSink> sink();
+
+    private:
+        static std::atomic<bool> enabled_;
+    };
+
+    // times a phase from construction to destruction. without a sink it
+    // costs a relaxed load, and the setters do nothing
+    class YamlTraceScope {
+    public:
+        YamlTraceScope(const char *name, std::string_view file_name = std::string_view()) {
+            if (YamlTracer::enabled())
+                Begin(name, file_name);
+        }
+
+        ~YamlTraceScope() {
+            if (sink_)
+                End();
+        }
+
+        YamlTraceScope(const YamlTraceScope &) = delete;
+
+        YamlTraceScope &operator=(const YamlTraceScope &) = delete;
+
+        void set_bytes(uint64_t bytes) { span_.bytes = bytes; }
+
+        void set_nodes(uint64_t nodes) { span_.nodes = nodes; }
+
+    private:
+        void Begin(const char *name, std::string_view file_name);
+
+        void End();
+
+        an<YamlTraceSink> sink_;
+        YamlTraceSpan span_;
+    };
+
+    // collects spans as complete events of the Chrome trace event format
+    // and writes them as a JSON file on Flush(), and when destroyed; the
+    // file opens in chrome://tracing or ui.perfetto.dev
+    class YamlChromeTraceSink : public YamlTraceSink {
+    public:
+        explicit YamlChromeTraceSink(const std::string &file_name);
+
+        ~YamlChromeTraceSink() override;
+
+        void Record(const YamlTraceSpan &span) override;
+
+        // writes all events recorded so far, replacing the file
+        bool Flush();
+
+    private:
+        std::string file_name_;
+        std::mutex mutex_;
+        // comma separated event objects
+        std::string events_;
+    };
+
+}  // namespace yaml
+
+#endif  // YAML_TRACE_H_
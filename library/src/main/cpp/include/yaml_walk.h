@@ -0,0 +1,159 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#ifndef YAML_WALK_H_
+#define YAML_WALK_H_
+
+#include <deque>
+#include <iterator>
+#include <yaml.h>
+
+namespace yaml {
+
+    // a node reached by a walk over a tree
+    struct YamlWalkStep {
+        // nullptr for a null node
+        const YamlItem *item = nullptr;
+        // where the node is held, nullptr for a root given as a raw pointer
+        const an<YamlItem> *slot = nullptr;
+        // the key of a map entry, nullptr for list elements and the root
+        const std::string *key = nullptr;
+        // position among the elements or entries of the parent
+        size_t index = 0;
+        // 0 for the root
+        size_t depth = 0;
+
+        YamlItem::ValueType type() const { return item ? item->type() : YamlItem::kNull; }
+    };
+
+    // the children of one list or map, in order. the elements of a packed
+    // list are not nodes of their own, read them through packed_array()
+    class YamlWalkFrame {
+    public:
+        // false if parent has no children to walk
+        bool Open(const YamlWalkStep &parent);
+
+        // the next child, or false once all have been walked
+        bool Next(YamlWalkStep *step);
+
+        const YamlWalkStep &parent() const { return parent_; }
+
+    private:
+        YamlWalkStep parent_;
+        size_t index_ = 0;
+        YamlList::ConstIterator element_;
+        YamlList::ConstIterator elements_end_;
+        YamlMap::ConstIterator entry_;
+        YamlMap::ConstIterator entries_end_;
+    };
+
+    // walks a tree depth first in document order, every list and map before
+    // its children. the stack is on the heap, so deep trees are safe on
+    // small native thread stacks. the tree must not change meanwhile
+    class YamlDepthFirstIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = YamlWalkStep;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const YamlWalkStep *;
+        using reference = const YamlWalkStep &;
+
+        // the end of any walk
+        YamlDepthFirstIterator() = default;
+
+        explicit YamlDepthFirstIterator(const an<YamlItem> &root);
+
+        explicit YamlDepthFirstIterator(const YamlItem *root);
+
+        reference operator*() const { return step_; }
+
+        pointer operator->() const { return &step_; }
+
+        YamlDepthFirstIterator &operator++();
+
+        // the next increment moves past the children of the current node
+        void SkipChildren() { skip_ = true; }
+
+        bool operator==(const YamlDepthFirstIterator &other) const {
+            return done_ == other.done_ && (done_ || (step_.item == other.step_.item &&
+                                                      step_.slot == other.step_.slot));
+        }
+
+        bool operator!=(const YamlDepthFirstIterator &other) const { return !(*this == other); }
+
+    private:
+        YamlWalkStep step_;
+        std::vector<YamlWalkFrame> stack_;
+        bool skip_ = false;
+        bool done_ = true;
+    };
+
+    // walks a tree level by level, each level in document order. holds a
+    // whole level at a time, so it needs more memory than depth first
+    class YamlBreadthFirstIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = YamlWalkStep;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const YamlWalkStep *;
+        using reference = const YamlWalkStep &;
+
+        YamlBreadthFirstIterator() = default;
+
+        explicit YamlBreadthFirstIterator(const an<YamlItem> &root);
+
+        explicit YamlBreadthFirstIterator(const YamlItem *root);
+
+        reference operator*() const { return queue_.front(); }
+
+        pointer operator->() const { return &queue_.front(); }
+
+        YamlBreadthFirstIterator &operator++();
+
+        // the children of the current node are not queued
+        void SkipChildren() { skip_ = true; }
+
+        bool operator==(const YamlBreadthFirstIterator &other) const {
+            return queue_.empty() == other.queue_.empty() &&
+                   (queue_.empty() || (queue_.front().item == other.queue_.front().item &&
+                                       queue_.front().slot == other.queue_.front().slot));
+        }
+
+        bool operator!=(const YamlBreadthFirstIterator &other) const { return !(*this == other); }
+
+    private:
+        std::deque<YamlWalkStep> queue_;
+        bool skip_ = false;
+    };
+
+    // callbacks of WalkYaml(), dispatched on YamlItem::ValueType
+    class YamlVisitor {
+    public:
+        virtual ~YamlVisitor() = default;
+
+        virtual void VisitNull(const YamlWalkStep &) {}
+
+        virtual void VisitScalar(const YamlWalkStep &, const YamlValue &) {}
+
+        // returning false skips the elements and EndList()
+        virtual bool BeginList(const YamlWalkStep &, const YamlList &) { return true; }
+
+        virtual void EndList(const YamlWalkStep &, const YamlList &) {}
+
+        // returning false skips the entries and EndMap()
+        virtual bool BeginMap(const YamlWalkStep &, const YamlMap &) { return true; }
+
+        virtual void EndMap(const YamlWalkStep &, const YamlMap &) {}
+    };
+
+    // visits a tree depth first in document order, without recursion.
+    // returns false, without visiting any deeper node, if the tree nests
+    // deeper than max_depth, unless 0
+    bool WalkYaml(const an<YamlItem> &root, YamlVisitor *visitor, size_t max_depth = 0);
+
+    bool WalkYaml(const YamlItem *root, YamlVisitor *visitor, size_t max_depth = 0);
+
+}  // namespace yaml
+
+#endif  // YAML_WALK_H_
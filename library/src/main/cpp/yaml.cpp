@@ -4,52 +4,137 @@
 //
 // 2011-04-06 Zou Xu <zouivex@gmail.com>
 //
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
+#include <yaml-cpp/eventhandler.h>
 #include <yaml-cpp/yaml.h>
-#include <yaml.h>
+#include <yaml_data.h>
+#include <yaml_diff.h>
+#include <yaml_json.h>
 
 namespace yaml {
 
-    class YamlData {
-    public:
-        YamlData() = default;
-
-        ~YamlData();
-
-        bool LoadFromStream(std::istream &stream);
-
-        bool SaveToStream(std::ostream &stream);
-
-        bool LoadFromFile(const std::string &file_name);
-
-        bool SaveToFile(const std::string &file_name);
-
-        an<YamlItem> Traverse(const std::string &key);
-
-        bool modified() const { return modified_; }
+// YamlItem members
 
-        void set_modified() { modified_ = true; }
+    YamlItem::YamlItem(const YamlItem &other)
+            : type_(other.type_),
+              hash_epoch_(other.hash_epoch_.load(std::memory_order_relaxed)),
+              hash_(other.hash_.load(std::memory_order_relaxed)),
+              owner_(other.owner_) {
+    }
 
-        an<YamlItem> root;
+    // bumped whenever a node with a cached hash is modified. a node without
+    // one has no hashed ancestors either, as hashing a node hashes its
+    // subtree, so building a tree leaves it alone
+    static std::atomic<uint32_t> hash_epoch{1};
 
-    protected:
-        static an<YamlItem> ConvertFromYaml(const YAML::Node &yaml_node);
+    void YamlItem::InvalidateHash() {
+        if (hash_.exchange(0, std::memory_order_relaxed))
+            hash_epoch.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        static void EmitYaml(an<YamlItem> node,
-                             YAML::Emitter *emitter,
-                             int depth);
+    uint64_t YamlItem::CachedHash() const {
+        uint64_t h = hash_.load(std::memory_order_relaxed);
+        if (h && hash_epoch_.load(std::memory_order_relaxed) !=
+                 hash_epoch.load(std::memory_order_relaxed))
+            return 0;
+        return h;
+    }
 
-        static void EmitScalar(const std::string &str_value,
-                               YAML::Emitter *emitter);
+    // boost::hash_combine, widened to 64 bits
+    static inline uint64_t CombineHash(uint64_t seed, uint64_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 12) + (seed >> 4));
+    }
 
-        std::string file_name_;
-        bool modified_ = false;
-    };
+    bool YamlItem::PushUnhashed(const YamlItem *item, std::vector<const YamlItem *> *pending) {
+        bool ready = true;
+        auto push = [&](const an<YamlItem> &child) {
+            if (child && child->type() != kScalar && !child->CachedHash()) {
+                pending->push_back(child.get());
+                ready = false;
+            }
+        };
+        if (auto list = Cast<YamlList>(item)) {
+            if (list->packed())
+                return true;
+            for (auto it = list->begin(), end = list->end(); it != end; ++it)
+                push(*it);
+        } else if (auto map = Cast<YamlMap>(item)) {
+            for (auto it = map->begin(), end = map->end(); it != end; ++it)
+                push(it->second);
+        }
+        return ready;
+    }
+
+    uint64_t YamlItem::hash() const {
+        uint64_t h = CachedHash();
+        if (h)
+            return h;
+        // children before their parents, without recursion
+        if (type_ == kList || type_ == kMap) {
+            std::vector<const YamlItem *> pending(1, this);
+            while (!pending.empty()) {
+                const YamlItem *item = pending.back();
+                if (item->CachedHash() || PushUnhashed(item, &pending)) {
+                    pending.pop_back();
+                    item->ComputeHash();
+                }
+            }
+        }
+        return ComputeHash();
+    }
+
+    uint64_t YamlItem::ComputeHash() const {
+        uint64_t h = CachedHash();
+        if (h)
+            return h;
+        // taken first, so that a write meanwhile leaves the result stale
+        uint32_t epoch = hash_epoch.load(std::memory_order_relaxed);
+        h = CombineHash(0, type_);
+        if (type_ == kScalar) {
+            h = CombineHash(h, std::hash<std::string>()(
+                    static_cast<const YamlValue *>(this)->str()));
+        } else if (type_ == kList) {
+            auto list = static_cast<const YamlList *>(this);
+            if (auto packed = list->packed_array()) {
+                // the same as for the unpacked elements
+                uint64_t scalar = CombineHash(0, kScalar);
+                for (size_t i = 0, size = packed->size(); i < size; ++i) {
+                    uint64_t element = CombineHash(scalar, std::hash<std::string>()(
+                            packed->Format(i)));
+                    h = CombineHash(h, element ? element : 1);
+                }
+            } else {
+                for (auto it = list->begin(), end = list->end(); it != end; ++it) {
+                    h = CombineHash(h, *it ? (*it)->hash() : 0);
+                }
+            }
+        } else if (type_ == kMap) {
+            // null values are not saved, so they do not count either
+            auto map = static_cast<const YamlMap *>(this);
+            for (auto it = map->begin(), end = map->end(); it != end; ++it) {
+                if (!it->second)
+                    continue;
+                h = CombineHash(h, std::hash<std::string>()(it->first));
+                h = CombineHash(h, it->second->hash());
+            }
+        }
+        if (!h)
+            h = 1;
+        hash_epoch_.store(epoch, std::memory_order_relaxed);
+        hash_.store(h, std::memory_order_relaxed);
+        return h;
+    }
 
 // YamlValue members
 
@@ -76,15 +161,17 @@ namespace yaml {
             : YamlItem(kScalar), value_(value) {
     }
 
+    YamlValue::YamlValue(std::string &&value)
+            : YamlItem(kScalar), value_(std::move(value)) {
+    }
+
     bool YamlValue::GetBool(bool *value) const {
         if (!value || value_.empty())
             return false;
-        std::string bstr = value_;
-        boost::to_lower(bstr);
-        if ("true" == bstr) {
+        if (boost::iequals(value_, "true")) {
             *value = true;
             return true;
-        } else if ("false" == bstr) {
+        } else if (boost::iequals(value_, "false")) {
             *value = false;
             return true;
         } else
@@ -132,44 +219,263 @@ namespace yaml {
     }
 
     bool YamlValue::SetBool(bool value) {
+        InvalidateHash();
         value_ = value ? "true" : "false";
         return true;
     }
 
     bool YamlValue::SetInt(int value) {
+        InvalidateHash();
         value_ = boost::lexical_cast<std::string>(value);
         return true;
     }
 
     bool YamlValue::SetDouble(double value) {
+        InvalidateHash();
         value_ = boost::lexical_cast<std::string>(value);
         return true;
     }
 
     bool YamlValue::SetString(const char *value) {
+        InvalidateHash();
         value_ = value;
         return true;
     }
 
     bool YamlValue::SetString(const std::string &value) {
+        InvalidateHash();
         value_ = value;
         return true;
     }
 
+// YamlPackedArray members
+
+    // the integer or fixed-point decimal spelled by text, if it is spelled
+    // exactly as the number would be formatted back
+    static bool ParsePacked(const std::string &text, bool *is_int, int64_t *int_value,
+                            double *double_value, int *decimals) {
+        size_t n = text.size();
+        size_t i = (n > 0 && text[0] == '-') ? 1 : 0;
+        size_t digits = i;
+        while (digits < n && text[digits] >= '0' && text[digits] <= '9')
+            ++digits;
+        // no sign alone, no leading zeros, at most 18 digits to fit int64_t
+        if (digits == i || (text[i] == '0' && digits > i + 1) || digits - i > 18)
+            return false;
+        if (digits == n) {
+            if (text == "-0")
+                return false;
+            *is_int = true;
+            *int_value = std::strtoll(text.c_str(), nullptr, 10);
+            return true;
+        }
+        if (text[digits] != '.')
+            return false;
+        size_t fraction = digits + 1;
+        size_t end = fraction;
+        while (end < n && text[end] >= '0' && text[end] <= '9')
+            ++end;
+        if (end != n || end == fraction || end - fraction > 15)
+            return false;
+        *is_int = false;
+        *decimals = int(end - fraction);
+        *double_value = std::strtod(text.c_str(), nullptr);
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.*f", *decimals, *double_value);
+        return text == buffer;
+    }
+
+    std::string YamlPackedArray::Format(size_t i) const {
+        if (!ints.empty())
+            return std::to_string(ints[i]);
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, doubles[i]);
+        return buffer;
+    }
+
+    bool YamlPackedArray::Store(size_t i, const std::string &text) {
+        bool is_int = false;
+        int64_t int_value = 0;
+        double double_value = 0;
+        int digits = 0;
+        if (i >= size() ||
+            !ParsePacked(text, &is_int, &int_value, &double_value, &digits) ||
+            is_int != !ints.empty() || (!is_int && digits != decimals))
+            return false;
+        if (is_int)
+            ints[i] = int_value;
+        else
+            doubles[i] = double_value;
+        return true;
+    }
+
+    // moves the only references to lists and maps held by item into
+    // pending, so that they are freed by the caller and not by item
+    static void DetachChildren(YamlItem *item, std::vector<an<YamlItem>> *pending) {
+        // iterated as const, as a write would retire cached hashes; item is
+        // going away, its children may still be taken
+        auto detach = [pending](const an<YamlItem> &child) {
+            if (child && child.use_count() == 1 &&
+                (child->type() == YamlItem::kList || child->type() == YamlItem::kMap))
+                pending->push_back(std::move(const_cast<an<YamlItem> &>(child)));
+        };
+        if (item->type() == YamlItem::kList) {
+            auto list = static_cast<const YamlList *>(item);
+            // packed elements are scalars
+            if (list->packed())
+                return;
+            for (auto it = list->begin(), end = list->end(); it != end; ++it)
+                detach(*it);
+        } else if (item->type() == YamlItem::kMap) {
+            auto map = static_cast<const YamlMap *>(item);
+            for (auto it = map->begin(), end = map->end(); it != end; ++it)
+                detach(it->second);
+        }
+    }
+
+    // frees the subtree below item without recursing through destructors,
+    // which a deep tree would overflow small native thread stacks with
+    static void ReleaseChildren(YamlItem *item) {
+        std::vector<an<YamlItem>> pending;
+        DetachChildren(item, &pending);
+        while (!pending.empty()) {
+            an<YamlItem> node = std::move(pending.back());
+            pending.pop_back();
+            DetachChildren(node.get(), &pending);
+        }
+    }
+
 // YamlList members
 
-    an<YamlItem> YamlList::GetAt(size_t i) const {
-        if (i >= seq_.size())
-            return nullptr;
+    YamlList::~YamlList() {
+        ReleaseChildren(this);
+    }
+
+    YamlList::YamlList(const YamlList &other)
+            : YamlItem(other) {
+        if (other.chunks_)
+            chunks_.reset(new YamlChunks(*other.chunks_));
+        else if (other.packed())
+            packed_ = other.packed_;
         else
-            return seq_[i];
+            seq_ = other.seq_;
+    }
+
+    void YamlList::Fit() {
+        if (chunks_ && chunks_->size() < kChunkThreshold / 2) {
+            seq_ = chunks_->Flatten();
+            chunks_.reset();
+        }
+    }
+
+    void YamlList::Expand() const {
+        if (!packed_ || expanded_.load(std::memory_order_acquire))
+            return;
+        // rare, so readers of all lists share one lock
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (expanded_.load(std::memory_order_relaxed))
+            return;
+        seq_.clear();
+        seq_.reserve(packed_->size());
+        for (size_t i = 0, size = packed_->size(); i < size; ++i) {
+            seq_.push_back(New<YamlValue>(packed_->Format(i)));
+        }
+        // a hash cached over the array is retired by writes to the elements
+        // only if they have theirs cached, too
+        if (CachedHash()) {
+            for (const auto &element : seq_)
+                element->hash();
+        }
+        expanded_.store(true, std::memory_order_release);
+    }
+
+    void YamlList::Unpack() {
+        if (!packed_)
+            return;
+        Expand();
+        packed_.reset();
+        expanded_.store(false, std::memory_order_relaxed);
+    }
+
+    bool YamlList::Pack() {
+        if (packed())
+            return true;
+        Unpack();
+        if (seq_.empty() || chunks_)
+            return false;
+        auto packed = New<YamlPackedArray>();
+        bool first_is_int = false;
+        for (size_t i = 0; i < seq_.size(); ++i) {
+            auto value = Cast<YamlValue>(seq_[i].get());
+            bool is_int = false;
+            int64_t int_value = 0;
+            double double_value = 0;
+            int decimals = 0;
+            if (!value || !ParsePacked(value->str(), &is_int, &int_value,
+                                       &double_value, &decimals))
+                return false;
+            if (i == 0) {
+                first_is_int = is_int;
+                packed->decimals = decimals;
+            } else if (is_int != first_is_int || decimals != packed->decimals) {
+                return false;
+            }
+            if (is_int)
+                packed->ints.push_back(int_value);
+            else
+                packed->doubles.push_back(double_value);
+        }
+        packed->ints.shrink_to_fit();
+        packed->doubles.shrink_to_fit();
+        packed_ = packed;
+        Sequence().swap(seq_);
+        return true;
+    }
+
+    YamlSpan<int64_t> YamlList::ints() const {
+        return packed() ? YamlSpan<int64_t>(packed_->ints.data(), packed_->ints.size())
+                        : YamlSpan<int64_t>();
+    }
+
+    YamlSpan<double> YamlList::doubles() const {
+        return packed() ? YamlSpan<double>(packed_->doubles.data(), packed_->doubles.size())
+                        : YamlSpan<double>();
+    }
+
+    an<YamlItem> YamlList::GetAt(size_t i) const {
+        auto slot = FindAt(i);
+        return slot ? *slot : nullptr;
     }
 
     an<YamlValue> YamlList::GetValueAt(size_t i) const {
         return As<YamlValue>(GetAt(i));
     }
 
+    const an<YamlItem> *YamlList::FindAt(size_t i) const {
+        if (chunks_)
+            return i < chunks_->size() ? &chunks_->at(i) : nullptr;
+        Expand();
+        return i < seq_.size() ? &seq_[i] : nullptr;
+    }
+
     bool YamlList::SetAt(size_t i, an<YamlItem> element) {
+        InvalidateHash();
+        auto value = Cast<YamlValue>(element.get());
+        if (packed() && value && i < packed_->size()) {
+            // copies of the list share the array until one of them writes
+            if (packed_.use_count() > 1)
+                packed_ = New<YamlPackedArray>(*packed_);
+            if (packed_->Store(i, value->str()))
+                return true;
+        }
+        Unpack();
+        if (chunks_) {
+            if (i >= chunks_->size())
+                chunks_->Resize(i + 1);
+            chunks_->at(i) = element;
+            return true;
+        }
         if (i >= seq_.size())
             seq_.resize(i + 1);
         seq_[i] = element;
@@ -177,6 +483,16 @@ namespace yaml {
     }
 
     bool YamlList::Insert(size_t i, an<YamlItem> element) {
+        InvalidateHash();
+        Unpack();
+        if (!chunks_ && i < seq_.size() && seq_.size() >= kChunkThreshold)
+            chunks_.reset(new YamlChunks(std::move(seq_)));
+        if (chunks_) {
+            if (i > chunks_->size())
+                chunks_->Resize(i);
+            chunks_->Insert(i, element);
+            return true;
+        }
         if (i > seq_.size()) {
             seq_.resize(i);
         }
@@ -184,35 +500,109 @@ namespace yaml {
         return true;
     }
 
+    bool YamlList::Erase(size_t i) {
+        if (i >= size())
+            return false;
+        InvalidateHash();
+        Unpack();
+        if (!chunks_ && i + 1 < seq_.size() && seq_.size() >= kChunkThreshold)
+            chunks_.reset(new YamlChunks(std::move(seq_)));
+        if (chunks_) {
+            chunks_->Erase(i);
+            Fit();
+            return true;
+        }
+        seq_.erase(seq_.begin() + i);
+        return true;
+    }
+
     bool YamlList::Append(an<YamlItem> element) {
-        seq_.push_back(element);
+        InvalidateHash();
+        Unpack();
+        if (chunks_)
+            chunks_->Append(std::move(element));
+        else
+            seq_.push_back(std::move(element));
         return true;
     }
 
     bool YamlList::Resize(size_t size) {
+        InvalidateHash();
+        Unpack();
+        if (chunks_) {
+            chunks_->Resize(size);
+            Fit();
+            return true;
+        }
         seq_.resize(size);
         return true;
     }
 
+    void YamlList::Reserve(size_t size) {
+        if (!packed() && !chunks_)
+            seq_.reserve(size);
+    }
+
     bool YamlList::Clear() {
+        InvalidateHash();
+        Unpack();
+        chunks_.reset();
         seq_.clear();
         return true;
     }
 
     size_t YamlList::size() const {
-        return seq_.size();
+        return packed() ? packed_->size() : chunks_ ? chunks_->size() : seq_.size();
+    }
+
+    size_t YamlList::capacity() const {
+        return chunks_ ? chunks_->capacity() : seq_.capacity();
     }
 
     YamlList::Iterator YamlList::begin() {
-        return seq_.begin();
+        InvalidateHash();
+        Expand();
+        if (chunks_) {
+            auto &chunks = chunks_->chunks();
+            return Iterator(&chunks.front(), &chunks.back(), 0);
+        }
+        return Iterator(seq_.data());
     }
 
     YamlList::Iterator YamlList::end() {
-        return seq_.end();
+        InvalidateHash();
+        Expand();
+        if (chunks_) {
+            auto &chunks = chunks_->chunks();
+            return Iterator(&chunks.back(), &chunks.back(), chunks.back().size());
+        }
+        return Iterator(seq_.data() + seq_.size());
+    }
+
+    YamlList::ConstIterator YamlList::begin() const {
+        if (chunks_) {
+            const auto &chunks = chunks_->chunks();
+            return ConstIterator(&chunks.front(), &chunks.back(), 0);
+        }
+        Expand();
+        return ConstIterator(seq_.data());
+    }
+
+    YamlList::ConstIterator YamlList::end() const {
+        if (chunks_) {
+            const auto &chunks = chunks_->chunks();
+            return ConstIterator(&chunks.back(), &chunks.back(), chunks.back().size());
+        }
+        Expand();
+        return ConstIterator(seq_.data() + seq_.size());
     }
 
 // YamlMap members
 
+    YamlMap::~YamlMap() {
+        ReleaseChildren(this);
+    }
+
     bool YamlMap::HasKey(const std::string &key) const {
         return bool(Get(key));
     }
@@ -229,21 +619,56 @@ namespace yaml {
         return As<YamlValue>(Get(key));
     }
 
+    const an<YamlItem> *YamlMap::Find(std::string_view key) const {
+        auto it = map_.find(key);
+        return it != map_.end() ? &it->second : nullptr;
+    }
+
     bool YamlMap::Set(const std::string &key, an<YamlItem> element) {
-        map_[key] = element;
+        InvalidateHash();
+        map_[key] = std::move(element);
+        return true;
+    }
+
+    bool YamlMap::Set(std::string &&key, an<YamlItem> element) {
+        InvalidateHash();
+        map_.insert_or_assign(std::move(key), std::move(element));
+        return true;
+    }
+
+    bool YamlMap::Append(std::string &&key, an<YamlItem> element) {
+        if (!map_.empty() && !(map_.rbegin()->first < key))
+            return false;
+        InvalidateHash();
+        map_.emplace_hint(map_.end(), std::move(key), std::move(element));
         return true;
     }
 
     bool YamlMap::Clear() {
+        InvalidateHash();
         map_.clear();
         return true;
     }
 
+    size_t YamlMap::size() const {
+        return map_.size();
+    }
+
     YamlMap::Iterator YamlMap::begin() {
+        InvalidateHash();
         return map_.begin();
     }
 
     YamlMap::Iterator YamlMap::end() {
+        InvalidateHash();
+        return map_.end();
+    }
+
+    YamlMap::ConstIterator YamlMap::begin() const {
+        return map_.begin();
+    }
+
+    YamlMap::ConstIterator YamlMap::end() const {
         return map_.end();
     }
 
@@ -303,15 +728,35 @@ namespace yaml {
 
     an<YamlList> YamlItemRef::AsList() {
         auto list = As<YamlList>(GetItem());
-        if (!list)
-            SetItem(list = New<YamlList>());
+        if (!list) {
+            list = New<YamlList>();
+            data_->Claim(list.get());
+            if (InstallItem(list))
+                Installed(true);
+        } else if (!data_->Owns(list.get())) {
+            list = std::static_pointer_cast<YamlList>(data_->Own(list));
+            if (InstallItem(list))
+                Installed(false);
+        }
+        // about to be modified through an entry ref
+        data_->InvalidateHashes(path_, list.get());
         return list;
     }
 
     an<YamlMap> YamlItemRef::AsMap() {
         auto map = As<YamlMap>(GetItem());
-        if (!map)
-            SetItem(map = New<YamlMap>());
+        if (!map) {
+            map = New<YamlMap>();
+            data_->Claim(map.get());
+            if (InstallItem(map))
+                Installed(true);
+        } else if (!data_->Owns(map.get())) {
+            map = std::static_pointer_cast<YamlMap>(data_->Own(map));
+            if (InstallItem(map))
+                Installed(false);
+        }
+        // about to be modified through an entry ref
+        data_->InvalidateHashes(path_, map.get());
         return map;
     }
 
@@ -320,8 +765,9 @@ namespace yaml {
     }
 
     bool YamlItemRef::Append(an<YamlItem> item) {
-        if (AsList()->Append(item)) {
-            set_modified();
+        auto list = AsList();
+        if (list->Append(item)) {
+            MarkModified(ChildPath("@" + std::to_string(list->size() - 1)));
             return true;
         }
         return false;
@@ -341,9 +787,44 @@ namespace yaml {
         return data_ && data_->modified();
     }
 
+    // paths that may have changed when key is written: the key and its subtree,
+    // or the whole of the first list on the way, whose elements may shift.
+    // "/" is the root, as for reads
+    static std::string_view ModifiedPrefix(std::string_view key) {
+        if (key == "/" || (!key.empty() && key[0] == '@')) {
+            return std::string_view();
+        }
+        size_t pos = key.find("/@");
+        return pos == std::string_view::npos ? key : key.substr(0, pos);
+    }
+
     void YamlItemRef::set_modified() {
+        MarkModified(path_);
+    }
+
+    void YamlItemRef::Installed(bool created) {
+        if (!data_)
+            return;
+        if (!created) {
+            data_->InvalidateIndex(ModifiedPrefix(path_));
+            return;
+        }
+        // empty, and needed to replay the writes below
+        data_->set_modified(ModifiedPrefix(path_));
+        data_->Journal({path_});
+    }
+
+    void YamlItemRef::CountSetItem() const {
         if (data_)
-            data_->set_modified();
+            data_->Count(YamlStatsCounter::kSetItemCalls);
+    }
+
+    void YamlItemRef::MarkModified(const std::string &written) {
+        if (!data_)
+            return;
+        data_->set_modified(ModifiedPrefix(path_));
+        data_->notifier().Notify(path_);
+        data_->Journal({written});
     }
 
 // Yaml members
@@ -351,9 +832,17 @@ namespace yaml {
     Yaml::Yaml() : YamlItemRef(New<YamlData>()) {
     }
 
+    Yaml::Yaml(const an<YamlData> &data) : YamlItemRef(data) {
+    }
+
     Yaml::~Yaml() {
     }
 
+    Yaml Yaml::Clone() const {
+        data_->Await();
+        return Yaml(data_->Clone());
+    }
+
     bool Yaml::LoadFromStream(std::istream &stream) {
         return data_->LoadFromStream(stream);
     }
@@ -366,10 +855,112 @@ namespace yaml {
         return data_->LoadFromFile(file_name);
     }
 
+    an<YamlLoadTask> Yaml::LoadFromFileAsync(const std::string &file_name,
+                                             YamlLoadCallback callback,
+                                             YamlLoader::Priority priority) {
+        return YamlData::LoadFromFileAsync(data_, file_name, YamlData::kYamlFormat,
+                                           priority, callback);
+    }
+
     bool Yaml::SaveToFile(const std::string &file_name) {
         return data_->SaveToFile(file_name);
     }
 
+    bool Yaml::SaveToStream(std::ostream &stream, const YamlSaveOptions &options) {
+        return data_->SaveToStream(stream, YamlData::kYamlFormat, options);
+    }
+
+    bool Yaml::SaveToFile(const std::string &file_name, const YamlSaveOptions &options) {
+        return data_->SaveToFile(file_name, YamlData::kYamlFormat, options);
+    }
+
+    bool Yaml::LoadFromJson(std::istream &stream) {
+        return data_->LoadFromStream(stream, YamlData::kJsonFormat);
+    }
+
+    bool Yaml::SaveToJson(std::ostream &stream) {
+        return data_->SaveToStream(stream, YamlData::kJsonFormat);
+    }
+
+    bool Yaml::LoadFromJsonFile(const std::string &file_name) {
+        return data_->LoadFromFile(file_name, YamlData::kJsonFormat);
+    }
+
+    bool Yaml::SaveToJsonFile(const std::string &file_name) {
+        return data_->SaveToFile(file_name, YamlData::kJsonFormat);
+    }
+
+    void Yaml::SetLoadLimits(const YamlLoadLimits &limits) {
+        data_->set_load_limits(limits);
+    }
+
+    void Yaml::EnableDedup(bool enabled) {
+        data_->set_dedup(enabled);
+    }
+
+    void Yaml::EnablePacking(bool enabled) {
+        data_->set_pack_numbers(enabled);
+    }
+
+    void Yaml::EnableJournal(size_t compact_bytes) {
+        data_->EnableJournal(compact_bytes);
+    }
+
+    void Yaml::DisableJournal() {
+        data_->DisableJournal();
+    }
+
+    void Yaml::EnableAccessProfile(std::chrono::milliseconds window) {
+        data_->EnableAccessProfile(window);
+    }
+
+    bool Yaml::SaveAccessProfile() {
+        return data_->SaveAccessProfile();
+    }
+
+    bool Yaml::PublishShared(const an<YamlSharedSegment> &segment) {
+        data_->Await();
+        if (!segment)
+            return false;
+        return segment->Publish(GetItem().get());
+    }
+
+    bool Yaml::AttachShared(const an<YamlSharedSegment> &segment) {
+        data_->Await();
+        if (!segment)
+            return false;
+        data_->AttachShared(segment);
+        return true;
+    }
+
+    void Yaml::GetStats(YamlStats *stats) const {
+        data_->stats().Snapshot(stats);
+    }
+
+    const YamlStatsCounter &Yaml::stats() const {
+        return data_->stats();
+    }
+
+    void Yaml::ResetStats() {
+        data_->stats().Reset();
+    }
+
+    void Yaml::SetTraceSink(an<YamlTraceSink> sink) {
+        YamlTracer::set_sink(std::move(sink));
+    }
+
+    void Yaml::EnableStats(bool enabled) {
+        YamlStatsCounter::set_enabled(enabled);
+    }
+
+    void Yaml::GetGlobalStats(YamlStats *stats) {
+        YamlStatsCounter::global().Snapshot(stats);
+    }
+
+    void Yaml::ResetGlobalStats() {
+        YamlStatsCounter::global().Reset();
+    }
+
     bool Yaml::IsNull(const std::string &key) {
         auto p = data_->Traverse(key);
         return !p || p->type() == YamlItem::kNull;
@@ -434,6 +1025,71 @@ namespace yaml {
         return As<YamlMap>(data_->Traverse(key));
     }
 
+    const YamlItem *Yaml::PeekItem(std::string_view key) const {
+        an<YamlItem> hold;
+        auto slot = data_->FindSlot(key, &hold);
+        return slot ? slot->get() : nullptr;
+    }
+
+    std::optional<bool> Yaml::PeekBool(std::string_view key) const {
+        bool value = false;
+        auto p = Cast<YamlValue>(PeekItem(key));
+        if (p && p->GetBool(&value))
+            return value;
+        return std::nullopt;
+    }
+
+    std::optional<int> Yaml::PeekInt(std::string_view key) const {
+        int value = 0;
+        auto p = Cast<YamlValue>(PeekItem(key));
+        if (p && p->GetInt(&value))
+            return value;
+        return std::nullopt;
+    }
+
+    std::optional<double> Yaml::PeekDouble(std::string_view key) const {
+        double value = 0.0;
+        auto p = Cast<YamlValue>(PeekItem(key));
+        if (p && p->GetDouble(&value))
+            return value;
+        return std::nullopt;
+    }
+
+    std::optional<std::string_view> Yaml::PeekString(std::string_view key) const {
+        if (auto p = Cast<YamlValue>(PeekItem(key)))
+            return std::string_view(p->str());
+        return std::nullopt;
+    }
+
+    void Yaml::EnablePathIndex(bool build_now) {
+        data_->EnableIndex(build_now);
+    }
+
+    void Yaml::DisablePathIndex() {
+        data_->DisableIndex();
+    }
+
+    void Yaml::InvalidatePathIndex(const std::string &prefix) {
+        data_->InvalidateIndex(prefix);
+    }
+
+    int Yaml::Subscribe(const std::string &prefix, YamlChangeHandler handler,
+                        YamlExecutor executor) {
+        return data_->notifier().Subscribe(prefix, handler, executor);
+    }
+
+    void Yaml::Unsubscribe(int subscription) {
+        data_->notifier().Unsubscribe(subscription);
+    }
+
+    void Yaml::BeginBatch() {
+        data_->notifier().BeginBatch();
+    }
+
+    void Yaml::EndBatch() {
+        data_->notifier().EndBatch();
+    }
+
     bool Yaml::SetBool(const std::string &key, bool value) {
         return SetItem(key, New<YamlValue>(value));
     }
@@ -454,49 +1110,58 @@ namespace yaml {
         return SetItem(key, New<YamlValue>(value));
     }
 
-    static inline bool IsListItemReference(const std::string &key) {
+    static inline bool IsListItemReference(std::string_view key) {
         return !key.empty() && key[0] == '@';
     }
 
-    static size_t ResolveListIndex(an<YamlItem> p, const std::string &key,
-                                   bool read_only = false) {
-        //if (!IsListItemReference(key)) {
-        //  return 0;
-        //}
-        an<YamlList> list = As<YamlList>(p);
-        if (!list) {
-            return 0;
-        }
-        const std::string kAfter("after");
-        const std::string kBefore("before");
-        const std::string kLast("last");
-        const std::string kNext("next");
+    // parses "@N", "@last", "@next", "@before N", "@after last" and the like
+    static size_t ParseListIndex(std::string_view key, size_t list_size,
+                                 bool *will_insert) {
+        const std::string_view kAfter("after");
+        const std::string_view kBefore("before");
+        const std::string_view kLast("last");
+        const std::string_view kNext("next");
         size_t cursor = 1;
-        unsigned int index = 0;
-        bool will_insert = false;
+        size_t index = 0;
+        *will_insert = false;
         if (key.compare(cursor, kNext.length(), kNext) == 0) {
             cursor += kNext.length();
-            index = list->size();
+            index = list_size;
         } else if (key.compare(cursor, kBefore.length(), kBefore) == 0) {
             cursor += kBefore.length();
-            will_insert = true;
+            *will_insert = true;
         } else if (key.compare(cursor, kAfter.length(), kAfter) == 0) {
             cursor += kAfter.length();
             index += 1;  // after i == before i+1
-            will_insert = true;
+            *will_insert = true;
         }
         if (cursor < key.length() && key[cursor] == ' ') {
             ++cursor;
         }
         if (key.compare(cursor, kLast.length(), kLast) == 0) {
             cursor += kLast.length();
-            index += list->size();
+            index += list_size;
             if (index != 0) {  // when list is empty, (before|after) last == 0
                 --index;
             }
         } else {
-            index += std::strtoul(key.c_str() + cursor, NULL, 10);
+            size_t number = 0;
+            while (cursor < key.length() && key[cursor] >= '0' && key[cursor] <= '9') {
+                number = number * 10 + (key[cursor++] - '0');
+            }
+            index += number;
+        }
+        return index;
+    }
+
+    static size_t ResolveListIndex(an<YamlItem> p, const std::string &key,
+                                   bool read_only = false) {
+        an<YamlList> list = As<YamlList>(p);
+        if (!list) {
+            return 0;
         }
+        bool will_insert = false;
+        size_t index = ParseListIndex(key, list->size(), &will_insert);
         if (will_insert && !read_only) {
             list->Insert(index, nullptr);
         }
@@ -505,198 +1170,1265 @@ namespace yaml {
 
     bool Yaml::SetItem(const std::string &key, an<YamlItem> item) {
         ALOGI("write: %s", key.c_str());
-        if (key.empty() || key == "/") {
-            data_->root = item;
-            data_->set_modified();
+        data_->Await();
+        data_->Count(YamlStatsCounter::kSetItemCalls);
+        if (data_->shared()) {
+            ALOGE("config read from shared memory is read-only.");
+            return false;
+        }
+        if (data_->in_transaction()) {
+            data_->Stage(key, item);
             return true;
         }
-        if (!data_->root) {
-            data_->root = New<YamlMap>();
+        bool copied = false;
+        if (!data_->WriteAt(&data_->root, key, item, nullptr, &copied)) {
+            // lists on the way may have grown by an inserted slot
+            data_->InvalidateIndex(ModifiedPrefix(key));
+            return false;
         }
-        an<YamlItem> p(data_->root);
-        std::vector<std::string> keys;
-        boost::split(keys, key, boost::is_any_of("/"));
-        size_t k = keys.size() - 1;
-        for (size_t i = 0; i <= k; ++i) {
-            YamlItem::ValueType node_type = YamlItem::kMap;
-            size_t list_index = 0;
-            if (IsListItemReference(keys[i])) {
-                node_type = YamlItem::kList;
-                list_index = ResolveListIndex(p, keys[i]);
-                ALOGI("list index : %s == %d", keys[i].c_str(), list_index);
-            }
-            if (!p || p->type() != node_type) {
-                return false;
-            }
-            if (i == k) {
-                if (node_type == YamlItem::kList) {
-                    As<YamlList>(p)->SetAt(list_index, item);
-                } else {
-                    As<YamlMap>(p)->Set(keys[i], item);
-                }
-                data_->set_modified();
-                return true;
-            } else {
-                an<YamlItem> next;
-                if (node_type == YamlItem::kList) {
-                    next = As<YamlList>(p)->GetAt(list_index);
-                } else {
-                    next = As<YamlMap>(p)->Get(keys[i]);
-                }
-                if (!next) {
-                    if (IsListItemReference(keys[i + 1])) {
-                        ALOGI("creating list node for key: %s", keys[i + 1].c_str());
-                        next = New<YamlList>();
-                    } else {
-                        ALOGI("creating map node for key: %s", keys[i + 1].c_str());
-                        next = New<YamlMap>();
-                    }
-                    if (node_type == YamlItem::kList) {
-                        As<YamlList>(p)->SetAt(list_index, next);
-                    } else {
-                        As<YamlMap>(p)->Set(keys[i], next);
-                    }
-                }
-                p = next;
-            }
-        }
-        return false;
+        // copies of shared nodes replace indexed ancestors
+        if (copied)
+            data_->InvalidateCopiedPath(key);
+        data_->set_modified(ModifiedPrefix(key));
+        data_->notifier().Notify(key);
+        data_->Journal({key});
+        return true;
+    }
+
+    bool Yaml::Begin() {
+        return data_->Begin();
+    }
+
+    bool Yaml::Commit() {
+        return data_->Commit();
+    }
+
+    void Yaml::Rollback() {
+        data_->Rollback();
     }
 
     an<YamlItem> Yaml::GetItem() const {
-        return data_->root;
+        data_->Await();
+        if (data_->shared())
+            return data_->Traverse("");
+        return data_->root_snapshot();
     }
 
     void Yaml::SetItem(an<YamlItem> item) {
-        data_->root = item;
-        set_modified();
+        data_->Await();
+        data_->Count(YamlStatsCounter::kSetItemCalls);
+        if (InstallItem(std::move(item)))
+            set_modified();
+    }
+
+    bool Yaml::InstallItem(an<YamlItem> item) {
+        data_->Await();
+        if (data_->shared()) {
+            ALOGE("config read from shared memory is read-only.");
+            return false;
+        }
+        std::atomic_store(&data_->root, std::move(item));
+        return true;
     }
 
 // YamlData members
 
+    static uint64_t NextOwner() {
+        static std::atomic<uint64_t> next_owner(0);
+        return ++next_owner;
+    }
+
+    // packs lists long enough for the typed array to pay off
+    static void PackList(YamlItem *item) {
+        auto list = static_cast<YamlList *>(item);
+        if (list->size() >= YamlList::kPackThreshold && !list->packed())
+            list->Pack();
+    }
+
+    namespace {
+
+        // builds the tree straight from parser events rather than through
+        // YAML::Node, so that load limits are enforced while the document is
+        // still being scanned
+        class TreeBuilder : public YAML::EventHandler {
+        public:
+            TreeBuilder(const YamlData &data, YamlLoadBudget *budget, bool pack_numbers)
+                    : data_(data), budget_(budget), pack_numbers_(pack_numbers) {
+            }
+
+            const an<YamlItem> &root() const { return root_; }
+
+            size_t node_count() const { return nodes_; }
+
+            // nodes referenced by an alias, and so held more than once
+            const std::vector<an<YamlItem>> &aliased() const { return aliased_; }
+
+            const std::unordered_map<const YamlItem *, std::string> &anchor_names() const {
+                return names_;
+            }
+
+            void OnDocumentStart(const YAML::Mark &) override {}
+
+            void OnDocumentEnd() override {}
+
+            void OnNull(const YAML::Mark &mark, YAML::anchor_t anchor) override {
+                if (ExpectsKey()) {
+                    SetKey(mark, "null");
+                    return;
+                }
+                Enter(mark);
+                Built(YamlStatsCounter::kNullNodes);
+                Add(anchor, nullptr);
+                Grow(1);
+            }
+
+            void OnAlias(const YAML::Mark &mark, YAML::anchor_t anchor) override {
+                an<YamlItem> target = anchor < anchors_.size() ? anchors_[anchor] : nullptr;
+                if (ExpectsKey()) {
+                    auto value = Cast<YamlValue>(target.get());
+                    if (target && !value)
+                        throw YAML::ParserException(mark, "map key is not a scalar");
+                    SetKey(mark, value ? value->str() : "null");
+                    return;
+                }
+                if (!target) {
+                    Enter(mark);
+                    Add(YAML::NullAnchor, nullptr);
+                    Grow(1);
+                    return;
+                }
+                for (const auto &frame : stack_) {
+                    if (frame.node == target)
+                        throw YAML::ParserException(mark, "alias refers to an enclosing node");
+                }
+                // the alias shares the anchored node rather than copying it,
+                // but walks expand it, so it counts as its anchor's nodes
+                size_t size = sizes_[anchor];
+                Enter(mark, size);
+                aliased_.push_back(target);
+                Add(YAML::NullAnchor, target);
+                Grow(size);
+            }
+
+            // not virtual in older yaml-cpp, where names are then not kept
+            void OnAnchor(const YAML::Mark &, const std::string &anchor_name) {
+                pending_name_ = anchor_name;
+            }
+
+            void OnScalar(const YAML::Mark &mark, const std::string &,
+                          YAML::anchor_t anchor, const std::string &value) override {
+                if (ExpectsKey()) {
+                    SetKey(mark, value);
+                    return;
+                }
+                Enter(mark);
+                Built(YamlStatsCounter::kScalarNodes);
+                Check(mark, budget_->CheckScalar(value.size()));
+                Add(anchor, New<YamlValue>(value));
+                Grow(1);
+            }
+
+            void OnSequenceStart(const YAML::Mark &mark, const std::string &,
+                                 YAML::anchor_t anchor, YAML::EmitterStyle::value) override {
+                Open(mark, anchor, New<YamlList>(), YamlStatsCounter::kListNodes);
+            }
+
+            void OnSequenceEnd() override {
+                if (pack_numbers_)
+                    PackList(stack_.back().node.get());
+                Close();
+            }
+
+            void OnMapStart(const YAML::Mark &mark, const std::string &,
+                            YAML::anchor_t anchor, YAML::EmitterStyle::value) override {
+                Open(mark, anchor, New<YamlMap>(), YamlStatsCounter::kMapNodes);
+            }
+
+            void OnMapEnd() override {
+                Close();
+            }
+
+        private:
+            struct Frame {
+                an<YamlItem> node;
+                std::string key;
+                bool has_key;
+                YAML::anchor_t anchor;
+                // nodes in the subtree with aliases expanded, saturated
+                size_t size;
+            };
+
+            void Check(const YAML::Mark &mark, bool ok) {
+                if (!ok)
+                    throw YAML::ParserException(mark, budget_->error());
+            }
+
+            void Enter(const YAML::Mark &mark, size_t nodes = 1) {
+                Check(mark, budget_->EnterNode(stack_.size(), nodes));
+            }
+
+            // adds a finished child of size nodes to the enclosing container
+            void Grow(size_t nodes) {
+                if (stack_.empty())
+                    return;
+                size_t &size = stack_.back().size;
+                size = nodes > SIZE_MAX - size ? SIZE_MAX : size + nodes;
+            }
+
+            void Close() {
+                Frame &top = stack_.back();
+                size_t size = top.size;
+                if (top.anchor != YAML::NullAnchor)
+                    sizes_[top.anchor] = size;
+                stack_.pop_back();
+                Grow(size);
+            }
+
+            void Built(YamlStatsCounter::Counter counter) {
+                ++nodes_;
+                data_.Count(counter);
+            }
+
+            bool ExpectsKey() const {
+                return !stack_.empty() && !stack_.back().has_key &&
+                       stack_.back().node->type() == YamlItem::kMap;
+            }
+
+            void SetKey(const YAML::Mark &mark, const std::string &key) {
+                Check(mark, budget_->CheckScalar(key.size()));
+                stack_.back().key = key;
+                stack_.back().has_key = true;
+            }
+
+            void Open(const YAML::Mark &mark, YAML::anchor_t anchor,
+                      const an<YamlItem> &node, YamlStatsCounter::Counter counter) {
+                if (ExpectsKey())
+                    throw YAML::ParserException(mark, "map key is not a scalar");
+                Enter(mark);
+                Built(counter);
+                Add(anchor, node);
+                stack_.push_back(Frame{node, std::string(), false, anchor, 1});
+            }
+
+            void Add(YAML::anchor_t anchor, const an<YamlItem> &item) {
+                if (anchor != YAML::NullAnchor) {
+                    if (anchors_.size() <= anchor) {
+                        anchors_.resize(anchor + 1);
+                        sizes_.resize(anchor + 1, 1);
+                    }
+                    anchors_[anchor] = item;
+                    sizes_[anchor] = 1;
+                    if (item && !pending_name_.empty())
+                        names_[item.get()] = pending_name_;
+                }
+                pending_name_.clear();
+                if (stack_.empty()) {
+                    root_ = item;
+                    return;
+                }
+                Frame &top = stack_.back();
+                if (top.node->type() == YamlItem::kList) {
+                    static_cast<YamlList *>(top.node.get())->Append(item);
+                } else {
+                    static_cast<YamlMap *>(top.node.get())->Set(std::move(top.key), item);
+                    top.has_key = false;
+                }
+            }
+
+            const YamlData &data_;
+            YamlLoadBudget *budget_;
+            bool pack_numbers_;
+            an<YamlItem> root_;
+            std::vector<Frame> stack_;
+            std::vector<an<YamlItem>> anchors_;
+            // expanded size of each anchored node, once it is complete
+            std::vector<size_t> sizes_;
+            std::vector<an<YamlItem>> aliased_;
+            std::unordered_map<const YamlItem *, std::string> names_;
+            std::string pending_name_;
+            size_t nodes_ = 0;
+        };
+
+    }  // namespace
+
     YamlData::~YamlData() {
-        if (modified_ && !file_name_.empty())
-            SaveToFile(file_name_);
+        FinishCompaction();
+        if (profile_)
+            profile_->Stop();
+        // journaled writes are replayed by the next load instead
+        if (modified_ && !file_name_.empty() && (!journal_enabled_ || journal_lost_))
+            SaveToFile(file_name_, format_);
     }
 
-    bool YamlData::LoadFromStream(std::istream &stream) {
+    bool YamlData::LoadFromStream(std::istream &stream, Format format) {
+        Await();
         if (!stream.good()) {
             ALOGE("failed to load config from stream.");
             return false;
         }
-        try {
-            YAML::Node doc = YAML::Load(stream);
-            root = ConvertFromYaml(doc);
+        std::string source;
+        if (!ReadStream(stream, &source))
+            return false;
+        an<YamlItem> previous = root;
+        bool success = LoadFromString(source, format);
+        NotifyReload(previous);
+        return success;
+    }
+
+    // the document whose asynchronous load runs on this thread, which must
+    // not wait for itself, e.g. in change handlers
+    static thread_local const YamlData *current_load = nullptr;
+
+    an<YamlLoadTask> YamlData::LoadFromFileAsync(const an<YamlData> &data,
+                                                 const std::string &file_name,
+                                                 Format format,
+                                                 YamlLoader::Priority priority,
+                                                 YamlLoadCallback callback) {
+        // readers seeing the load pending wait for the task scheduled here
+        std::lock_guard<std::mutex> lock(data->load_task_mutex_);
+        std::shared_future<bool> previous;
+        if (data->load_task_) {
+            data->load_task_->Cancel();
+            previous = data->load_task_->future();
         }
-        catch (YAML::Exception &e) {
-            ALOGE("Error parsing YAML: %s", e.what());
+        data->loads_pending_.fetch_add(1, std::memory_order_acq_rel);
+        auto job = [data, file_name, format, previous](const YamlLoadTask &task) {
+            // a superseded load may still be running
+            if (previous.valid())
+                previous.wait();
+            current_load = data.get();
+            data->cancel_ = task.cancel_flag();
+            bool success = data->LoadFromFile(file_name, format);
+            data->cancel_ = nullptr;
+            current_load = nullptr;
+            return success;
+        };
+        auto done = [data, callback](bool success) {
+            data->loads_pending_.fetch_sub(1, std::memory_order_acq_rel);
+            if (callback)
+                callback(success);
+        };
+        data->load_task_ = YamlLoader::instance().Schedule(job, priority, done);
+        return data->load_task_;
+    }
+
+    void YamlData::WaitForLoad() const {
+        if (current_load == this)
+            return;
+        an<YamlLoadTask> task;
+        {
+            std::lock_guard<std::mutex> lock(load_task_mutex_);
+            task = load_task_;
+        }
+        // the latest load waits for any it superseded
+        if (task)
+            task->Wait();
+    }
+
+    bool YamlData::ReadStream(std::istream &stream, std::string *source) {
+        if (!limits_.max_bytes) {
+            source->assign(std::istreambuf_iterator<char>(stream),
+                           std::istreambuf_iterator<char>());
+            return true;
+        }
+        // read one byte past the limit to tell an exact fit from overflow
+        char buffer[64 * 1024];
+        source->clear();
+        while (source->size() <= limits_.max_bytes) {
+            size_t left = limits_.max_bytes - source->size();
+            size_t bytes = left < sizeof(buffer) ? left + 1 : sizeof(buffer);
+            if (stream.read(buffer, bytes).gcount() <= 0)
+                break;
+            source->append(buffer, stream.gcount());
+        }
+        return CheckLoadBudget(source->size());
+    }
+
+    bool YamlData::CheckLoadBudget(size_t bytes) {
+        YamlLoadBudget budget(limits_);
+        if (budget.CheckBytes(bytes))
+            return true;
+        ALOGE("failed to load config: %s (%zu bytes).", budget.error().c_str(), bytes);
+        Count(YamlStatsCounter::kLoadFailures);
+        return false;
+    }
+
+    bool YamlData::LoadFromString(const std::string &source, Format format) {
+        auto start = std::chrono::steady_clock::now();
+        YamlTraceScope trace("parse", file_name_);
+        trace.set_bytes(source.size());
+        YamlLoadLimits limits = limits_;
+        // the YAML parser recurses once per level of nesting
+        if (format == kYamlFormat && !limits.max_depth)
+            limits.max_depth = kYamlParseDepth;
+        YamlLoadBudget budget(limits);
+        budget.set_cancel_flag(cancel_);
+        if (!budget.CheckBytes(source.size()) || !budget.CheckCanceled()) {
+            ALOGE("failed to load config: %s.", budget.error().c_str());
+            Count(YamlStatsCounter::kLoadFailures);
             return false;
         }
+        // built aside, so that a failed load leaves the current tree
+        an<YamlItem> doc;
+        if (format == kJsonFormat) {
+            YamlJsonReader reader;
+            reader.set_pack_numbers(pack_numbers_);
+            std::string error;
+            if (!reader.Parse(source, &doc, &error, &budget)) {
+                ALOGE("Error parsing JSON: %s", error.c_str());
+                Count(YamlStatsCounter::kLoadFailures);
+                return false;
+            }
+            anchor_names_.clear();
+            Count(YamlStatsCounter::kNullNodes, reader.node_count(YamlItem::kNull));
+            Count(YamlStatsCounter::kScalarNodes, reader.node_count(YamlItem::kScalar));
+            Count(YamlStatsCounter::kListNodes, reader.node_count(YamlItem::kList));
+            Count(YamlStatsCounter::kMapNodes, reader.node_count(YamlItem::kMap));
+            trace.set_nodes(reader.node_count(YamlItem::kNull) +
+                            reader.node_count(YamlItem::kScalar) +
+                            reader.node_count(YamlItem::kList) +
+                            reader.node_count(YamlItem::kMap));
+        } else {
+            try {
+                std::istringstream in(source);
+                YAML::Parser parser(in);
+                TreeBuilder builder(*this, &budget, pack_numbers_);
+                // only the first document is loaded
+                parser.HandleNextDocument(builder);
+                doc = builder.root();
+                // aliased nodes are copied by writes, like nodes of a clone
+                uint64_t shared_owner = NextOwner();
+                for (const auto &node : builder.aliased())
+                    Share(node.get(), shared_owner);
+                anchor_names_ = builder.anchor_names();
+                trace.set_nodes(builder.node_count());
+            }
+            catch (YAML::Exception &e) {
+                ALOGE("Error parsing YAML: %s", e.what());
+                Count(YamlStatsCounter::kLoadFailures);
+                return false;
+            }
+        }
+        if (dedup_) {
+            size_t replaced = Dedup(&doc);
+            ALOGI("shared %zu duplicate nodes.", replaced);
+        }
+        // a load replaces a tree read from shared memory
+        shared_.reset();
+        shared_nodes_.clear();
+        std::atomic_store(&root, std::move(doc));
+        // a freshly loaded tree is not shared with any clone
+        owner_ = 0;
+        ResetIndex();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Count(YamlStatsCounter::kLoads);
+        Count(YamlStatsCounter::kBytesParsed, source.size());
+        Count(YamlStatsCounter::kParseTimeUs,
+              std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
         return true;
     }
 
-    bool YamlData::SaveToStream(std::ostream &stream) {
+    bool YamlData::SaveToStream(std::ostream &stream, Format format) {
+        return SaveToStream(stream, format, save_options_);
+    }
+
+    bool YamlData::SaveToStream(std::ostream &stream, Format format,
+                                const YamlSaveOptions &options) {
+        Await();
         if (!stream.good()) {
             ALOGE("failed to save config to stream.");
             return false;
         }
+        // JSON is valid YAML, and the JSON writer is the most compact and
+        // fastest way to write the tree out
+        if (format == kJsonFormat || options.style == YamlSaveOptions::kMinified) {
+            if (!WriteJson(stream))
+                return false;
+            Count(YamlStatsCounter::kSaves);
+            return true;
+        }
         try {
             YAML::Emitter emitter(stream);
-            EmitYaml(root, &emitter, 0);
+            emitter.SetIndent(options.indent);
+            EmitContext context;
+            context.flow_depth = options.style == YamlSaveOptions::kFlow ? 0 : options.flow_depth;
+            // anchors depend on how nodes happen to be shared, not on content
+            if (!options.canonical)
+                CollectAnchors(root.get(), &context);
+            YamlTraceScope trace("emit", file_name_);
+            EmitYaml(root, &emitter, &context);
+            trace.set_bytes(emitter.size());
+            trace.set_nodes(context.emitted);
         }
         catch (YAML::Exception &e) {
             ALOGE("Error emitting YAML: %s", e.what());
             return false;
         }
+        Count(YamlStatsCounter::kSaves);
         return true;
     }
 
-    bool YamlData::LoadFromFile(const std::string &file_name) {
-        // update status
-        file_name_ = file_name;
-        modified_ = false;
-        root.reset();
+    bool YamlData::WriteJson(std::ostream &stream) {
+        std::string json;
+        {
+            YamlTraceScope trace("emit", file_name_);
+            YamlJsonWriter writer;
+            if (!writer.Write(root.get(), &json, limits_.max_depth)) {
+                ALOGE("Error emitting JSON: document exceeds max_depth");
+                return false;
+            }
+            trace.set_bytes(json.size());
+            trace.set_nodes(writer.node_count());
+        }
+        YamlTraceScope trace("write", file_name_);
+        trace.set_bytes(json.size());
+        if (!stream.write(json.data(), json.size())) {
+            ALOGE("failed to write JSON to stream.");
+            return false;
+        }
+        return true;
+    }
+
+    bool YamlData::LoadFromFile(const std::string &file_name, Format format) {
+        Await();
+        YamlTraceScope trace("load", file_name);
+        FinishCompaction();
+        an<YamlItem> previous = root;
+        std::string source;
+        bool success = ReadFile(file_name, &source) && LoadFromString(source, format);
+        trace.set_bytes(source.size());
+        // a failed load keeps the current tree, and with it the file it is
+        // saved back to
+        if (success) {
+            file_name_ = file_name;
+            format_ = format;
+            modified_ = false;
+            journal_lost_ = false;
+        }
+        if (success && journal_enabled_)
+            ReplayJournal();
+        if (success && profiling_)
+            Preload();
+        NotifyReload(previous);
+        return success;
+    }
+
+    bool YamlData::ReadFile(const std::string &file_name, std::string *source) {
+        YamlTraceScope trace("read", file_name);
         if (!boost::filesystem::exists(file_name)) {
             ALOGW("nonexistent config file '%s'.", file_name.c_str());
             return false;
         }
         ALOGI("loading config file '%s'.", file_name.c_str());
-        try {
-            YAML::Node doc = YAML::LoadFile(file_name);
-            root = ConvertFromYaml(doc);
-        }
-        catch (YAML::Exception &e) {
-            ALOGE("Error parsing YAML: %s", e.what());
+        std::ifstream in(file_name.c_str(), std::ios::binary);
+        if (!in.good()) {
+            ALOGE("failed to open config file '%s'.", file_name.c_str());
+            Count(YamlStatsCounter::kLoadFailures);
             return false;
         }
+        if (limits_.max_bytes) {
+            // refuse oversized files before reading any of them
+            boost::system::error_code ec;
+            auto size = boost::filesystem::file_size(file_name, ec);
+            if (!ec && !CheckLoadBudget(size))
+                return false;
+            bool success = ReadStream(in, source);
+            trace.set_bytes(source->size());
+            return success;
+        }
+        source->assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+        trace.set_bytes(source->size());
         return true;
     }
 
-    bool YamlData::SaveToFile(const std::string &file_name) {
+    void YamlData::NotifyReload(const an<YamlItem> &previous) {
+        if (!notifier_.has_subscribers())
+            return;
+        YamlDiff diff;
+        DiffYaml(previous.get(), root.get(), &diff);
+        std::vector<std::string> paths;
+        paths.reserve(diff.added.size() + diff.removed.size() + diff.changed.size());
+        paths.insert(paths.end(), diff.added.begin(), diff.added.end());
+        paths.insert(paths.end(), diff.removed.begin(), diff.removed.end());
+        paths.insert(paths.end(), diff.changed.begin(), diff.changed.end());
+        notifier_.Notify(paths);
+    }
+
+    bool YamlData::SaveToFile(const std::string &file_name, Format format) {
+        FinishCompaction();
         // update status
         file_name_ = file_name;
-        modified_ = false;
+        format_ = format;
         if (file_name.empty()) {
             // not really saving
+            modified_ = false;
             return false;
         }
 
         ALOGI("saving config file '%s'", file_name.c_str());
-        // dump tree
-        std::ofstream out(file_name.c_str());
-        return SaveToStream(out);
+        YamlTraceScope trace("save", file_name);
+        // dump tree aside, so that a failed save leaves the file as it was
+        std::string temp_file = file_name + ".tmp";
+        bool saved;
+        {
+            std::ofstream out(temp_file.c_str());
+            saved = SaveToStream(out, format) && out.flush();
+            trace.set_bytes(out.tellp());
+        }
+        boost::system::error_code ec;
+        if (saved)
+            boost::filesystem::rename(temp_file, file_name, ec);
+        if (!saved || ec) {
+            ALOGE("failed to save config file '%s'.", file_name.c_str());
+            boost::filesystem::remove(temp_file, ec);
+            return false;
+        }
+        modified_ = false;
+        // the file holds every journaled write now
+        if (auto journal = OpenJournal()) {
+            journal->Reset();
+            journal_lost_ = false;
+        }
+        return true;
+    }
+
+    bool YamlData::SaveToFile(const std::string &file_name, Format format,
+                              const YamlSaveOptions &options) {
+        save_options_ = options;
+        return SaveToFile(file_name, format);
     }
 
     an<YamlItem> YamlData::Traverse(const std::string &key) {
         ALOGI("traverse: %s", key.c_str());
+        an<YamlItem> hold;
+        auto slot = FindSlot(key, &hold);
+        return slot ? *slot : nullptr;
+    }
+
+    const an<YamlItem> *YamlData::FindSlot(std::string_view key, an<YamlItem> *hold) const {
+        Await();
+        Count(YamlStatsCounter::kTraversals);
+        if (shared_)
+            return SharedSlot(key == "/" ? std::string_view() : key, hold);
+        if (key.empty() || key == "/") {
+            *hold = root_snapshot();
+            return hold;
+        }
+        if (profile_)
+            profile_->Record(key);
+        if (!index_) {
+            return WalkSlot(key, hold);
+        }
+        size_t hash = YamlPathIndex::Hash(key);
+        if ((*hold = index_->Find(key, hash))) {
+            Count(YamlStatsCounter::kPathCacheHits);
+            return hold;
+        }
+        auto slot = WalkSlot(key, hold);
+        if (slot && *slot) {
+            index_->Insert(key, hash, *slot);
+        }
+        return slot;
+    }
+
+    void YamlData::InvalidateHashes(std::string_view key, const YamlItem *node) {
+        const YamlItem *p = root.get();
+        size_t start = 0;
+        while (p && p != node && start <= key.size()) {
+            p->ClearHash();
+            size_t end = std::min(key.find('/', start), key.size());
+            std::string_view segment = key.substr(start, end - start);
+            const an<YamlItem> *slot = nullptr;
+            if (IsListItemReference(segment)) {
+                auto list = Cast<YamlList>(p);
+                bool will_insert = false;
+                slot = list ? list->FindAt(ParseListIndex(segment, list->size(),
+                                                          &will_insert)) : nullptr;
+            } else if (auto map = Cast<YamlMap>(p)) {
+                slot = map->Find(segment);
+            }
+            p = slot ? slot->get() : nullptr;
+            start = end + 1;
+        }
+        if (p == node)
+            node->ClearHash();
+        else
+            const_cast<YamlItem *>(node)->InvalidateHash();
+    }
+
+    const an<YamlItem> *YamlData::WalkSlot(std::string_view key, an<YamlItem> *hold,
+                                           bool expand) const {
+        *hold = root_snapshot();
+        const an<YamlItem> *slot = hold;
+        size_t start = 0;
+        while (true) {
+            size_t end = key.find('/', start);
+            std::string_view segment = key.substr(start, end - start);
+            const YamlItem *p = slot->get();
+            if (IsListItemReference(segment)) {
+                auto list = Cast<YamlList>(p);
+                if (list && list->packed() && !expand)
+                    return nullptr;
+                bool will_insert = false;
+                slot = list ? list->FindAt(ParseListIndex(segment, list->size(),
+                                                          &will_insert)) : nullptr;
+            } else {
+                auto map = Cast<YamlMap>(p);
+                slot = map ? map->Find(segment) : nullptr;
+            }
+            if (!slot) {
+                Count(YamlStatsCounter::kFailedLookups);
+                return nullptr;
+            }
+            if (end == std::string_view::npos)
+                break;
+            start = end + 1;
+        }
+        if (!*slot) {
+            Count(YamlStatsCounter::kFailedLookups);
+        }
+        return slot;
+    }
+
+    an<YamlData> YamlData::Clone() {
+        auto copy = New<YamlData>();
+        copy->root = root;
+        copy->anchor_names_ = anchor_names_;
+        // from now on neither document may modify the shared nodes in place
+        owner_ = NextOwner();
+        copy->owner_ = NextOwner();
+        return copy;
+    }
+
+    an<YamlItem> YamlData::Own(const an<YamlItem> &item) const {
+        if (Owns(item.get()))
+            return item;
+        an<YamlItem> copy;
+        switch (item->type()) {
+            case YamlItem::kScalar:
+                copy = New<YamlValue>(*static_cast<const YamlValue *>(item.get()));
+                break;
+            case YamlItem::kList:
+                copy = New<YamlList>(*static_cast<const YamlList *>(item.get()));
+                break;
+            case YamlItem::kMap:
+                copy = New<YamlMap>(*static_cast<const YamlMap *>(item.get()));
+                break;
+            default:
+                copy = New<YamlItem>();
+                break;
+        }
+        Claim(copy.get());
+        return copy;
+    }
+
+    struct YamlData::InternTable {
+        std::unordered_multimap<uint64_t, an<YamlItem>> nodes;
+        // held by no document, so that every write copies shared nodes
+        uint64_t shared_owner;
+    };
+
+    // equality of nodes whose children are interned already, so that equal
+    // children are the same node
+    static bool SameShape(const YamlItem *a, const YamlItem *b) {
+        if (a->type() != b->type())
+            return false;
+        if (auto value = Cast<YamlValue>(a))
+            return value->str() == Cast<YamlValue>(b)->str();
+        if (auto list = Cast<YamlList>(a)) {
+            auto other = Cast<YamlList>(b);
+            if (list->packed() || other->packed()) {
+                auto x = list->packed_array(), y = other->packed_array();
+                return x && y && x->ints == y->ints && x->doubles == y->doubles &&
+                       x->decimals == y->decimals;
+            }
+            return list->size() == other->size() &&
+                   std::equal(list->begin(), list->end(), other->begin());
+        }
+        if (auto map = Cast<YamlMap>(a)) {
+            auto other = Cast<YamlMap>(b);
+            return map->size() == other->size() &&
+                   std::equal(map->begin(), map->end(), other->begin());
+        }
+        return true;
+    }
+
+    size_t YamlData::Dedup(an<YamlItem> *tree) {
+        if (!*tree)
+            return 0;
+        InternTable table;
+        table.shared_owner = NextOwner();
+        size_t replaced = 0;
+        Intern(tree, &table, &replaced);
+        return replaced;
+    }
+
+    void YamlData::Intern(an<YamlItem> *root, InternTable *table, size_t *replaced) {
+        // children first, so that equal subtrees reduce to equal child
+        // pointers; the pending slots are kept off the native stack
+        struct Pending {
+            an<YamlItem> *slot;
+            bool expanded;
+        };
+        std::vector<Pending> stack(1, Pending{root, false});
+        while (!stack.empty()) {
+            an<YamlItem> *slot = stack.back().slot;
+            YamlItem *item = slot->get();
+            if (!item) {
+                stack.pop_back();
+                continue;
+            }
+            if (!stack.back().expanded) {
+                stack.back().expanded = true;
+                size_t first = stack.size();
+                // packed elements are not nodes of their own
+                if (item->type() == YamlItem::kList && !static_cast<YamlList *>(item)->packed()) {
+                    auto list = static_cast<YamlList *>(item);
+                    for (auto it = list->begin(), end = list->end(); it != end; ++it)
+                        stack.push_back(Pending{&*it, false});
+                } else if (item->type() == YamlItem::kMap) {
+                    auto map = static_cast<YamlMap *>(item);
+                    for (auto it = map->begin(), end = map->end(); it != end; ++it)
+                        stack.push_back(Pending{&it->second, false});
+                }
+                // in document order, as the first of equal nodes is kept
+                std::reverse(stack.begin() + first, stack.end());
+                continue;
+            }
+            stack.pop_back();
+            uint64_t hash = item->hash();
+            auto range = table->nodes.equal_range(hash);
+            bool found = false;
+            for (auto it = range.first; it != range.second; ++it) {
+                if (SameShape(it->second.get(), item)) {
+                    Share(it->second.get(), table->shared_owner);
+                    *slot = it->second;
+                    ++*replaced;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                table->nodes.emplace(hash, *slot);
+        }
+    }
+
+    void YamlData::Share(YamlItem *item, uint64_t owner) {
+        // the whole subtree, as a copy of a shared node shares its children.
+        // packed elements are views, written only through the list
+        for (YamlDepthFirstIterator it(item), end; it != end; ++it) {
+            YamlItem *node = const_cast<YamlItem *>(it->item);
+            if (!node || node->owner_ == owner) {
+                it.SkipChildren();
+                continue;
+            }
+            node->owner_ = owner;
+        }
+    }
+
+    bool YamlData::WriteAt(an<YamlItem> *root_slot, const std::string &key,
+                           an<YamlItem> item, YamlWriteCache *cache,
+                           bool *copied) {
         if (key.empty() || key == "/") {
-            return root;
+            *root_slot = item;
+            *copied = true;
+            if (cache)
+                cache->Clear();
+            return true;
+        }
+        if (!*root_slot) {
+            *root_slot = New<YamlMap>();
+            Claim(root_slot->get());
         }
+        // nodes on the way are copied if shared with a clone
+        if (!Owns(root_slot->get())) {
+            *root_slot = Own(*root_slot);
+            *copied = true;
+        }
+        an<YamlItem> p(*root_slot);
         std::vector<std::string> keys;
         boost::split(keys, key, boost::is_any_of("/"));
-        // find the YAML::Node, and wrap it!
-        an<YamlItem> p = root;
-        for (auto it = keys.begin(), end = keys.end(); it != end; ++it) {
+        size_t k = keys.size() - 1;
+        size_t i = 0;
+        if (cache) {
+            // resume from the deepest node the previous write resolved
+            i = cache->Match(keys, k);
+            if (i > 0)
+                p = cache->nodes[i - 1];
+            cache->Truncate(i);
+        }
+        for (; i <= k; ++i) {
             YamlItem::ValueType node_type = YamlItem::kMap;
             size_t list_index = 0;
-            if (IsListItemReference(*it)) {
+            if (IsListItemReference(keys[i])) {
                 node_type = YamlItem::kList;
-                list_index = ResolveListIndex(p, *it, true);
+                list_index = ResolveListIndex(p, keys[i]);
+                ALOGI("list index : %s == %zu", keys[i].c_str(), list_index);
             }
             if (!p || p->type() != node_type) {
-                return nullptr;
+                return false;
             }
-            if (node_type == YamlItem::kList) {
-                p = As<YamlList>(p)->GetAt(list_index);
+            // the nodes on the way are this document's own, and reached
+            // from the root along this path only
+            p->ClearHash();
+            if (i == k) {
+                if (node_type == YamlItem::kList) {
+                    As<YamlList>(p)->SetAt(list_index, item);
+                } else {
+                    As<YamlMap>(p)->Set(keys[i], item);
+                }
+                return true;
             } else {
-                p = As<YamlMap>(p)->Get(*it);
+                an<YamlItem> next;
+                if (node_type == YamlItem::kList) {
+                    next = As<YamlList>(p)->GetAt(list_index);
+                } else {
+                    next = As<YamlMap>(p)->Get(keys[i]);
+                }
+                if (!next || !Owns(next.get())) {
+                    if (next) {
+                        next = Own(next);
+                        *copied = true;
+                    } else if (IsListItemReference(keys[i + 1])) {
+                        ALOGI("creating list node for key: %s", keys[i + 1].c_str());
+                        next = New<YamlList>();
+                        Claim(next.get());
+                    } else {
+                        ALOGI("creating map node for key: %s", keys[i + 1].c_str());
+                        next = New<YamlMap>();
+                        Claim(next.get());
+                    }
+                    if (node_type == YamlItem::kList) {
+                        As<YamlList>(p)->SetAt(list_index, next);
+                    } else {
+                        As<YamlMap>(p)->Set(keys[i], next);
+                    }
+                }
+                if (cache && node_type == YamlItem::kMap && cache->keys.size() == i) {
+                    cache->keys.push_back(keys[i]);
+                    cache->nodes.push_back(next);
+                }
+                p = next;
             }
         }
-        return p;
+        return false;
     }
 
-    an<YamlItem> YamlData::ConvertFromYaml(const YAML::Node &node) {
-        if (YAML::NodeType::Null == node.Type()) {
-            return nullptr;
+    bool YamlData::Begin() {
+        Await();
+        if (shared_) {
+            ALOGE("config read from shared memory is read-only.");
+            return false;
+        }
+        if (in_transaction_) {
+            ALOGW("transaction already in progress.");
+            return false;
+        }
+        in_transaction_ = true;
+        return true;
+    }
+
+    void YamlData::Stage(const std::string &key, an<YamlItem> item) {
+        staged_.emplace_back(key, item);
+    }
+
+    bool YamlData::Commit() {
+        Await();
+        if (!in_transaction_) {
+            return false;
+        }
+        in_transaction_ = false;
+        std::vector<std::pair<std::string, an<YamlItem>>> staged;
+        staged.swap(staged_);
+        if (staged.empty()) {
+            return true;
+        }
+        // with a fresh token no node reachable by readers is owned, so the
+        // writes copy their paths into a private tree, published at the end
+        uint64_t previous_owner = owner_;
+        owner_ = NextOwner();
+        an<YamlItem> working = root;
+        YamlWriteCache cache;
+        bool copied = false;
+        for (const auto &write : staged) {
+            if (!WriteAt(&working, write.first, write.second, &cache, &copied)) {
+                ALOGE("failed to commit write to '%s', rolled back.", write.first.c_str());
+                owner_ = previous_owner;
+                return false;
+            }
+        }
+        an<YamlItem> previous = root;
+        std::atomic_store(&root, std::move(working));
+        // no reader left on the previous tree, so the nodes it shares with
+        // the new one need not be copied by later writes
+        if (previous.use_count() == 1) {
+            uint64_t token = owner_;
+            owner_ = previous_owner;
+            Reclaim(token);
+        }
+        previous.reset();
+        // the writes copied their paths, the rest of the tree is shared
+        std::vector<std::string> paths;
+        paths.reserve(staged.size());
+        for (const auto &write : staged) {
+            InvalidateCopiedPath(write.first);
+            set_modified(ModifiedPrefix(write.first));
+            paths.push_back(write.first);
         }
-        if (YAML::NodeType::Scalar == node.Type()) {
-            return New<YamlValue>(node.as<std::string>());
+        notifier_.Notify(paths);
+        if (journal_enabled_) {
+            // one record, so that a transaction is replayed whole or not at all
+            Journal(paths);
+        } else if (!file_name_.empty()) {
+            SaveToFile(file_name_, format_);
         }
-        if (YAML::NodeType::Sequence == node.Type()) {
-            auto config_list = New<YamlList>();
-            for (auto it = node.begin(), end = node.end(); it != end; ++it) {
-                config_list->Append(ConvertFromYaml(*it));
+        return true;
+    }
+
+    void YamlData::Reclaim(uint64_t token) {
+        // copies only link to copies or to nodes owned before, which end
+        // the walk
+        std::vector<YamlItem *> pending(1, root.get());
+        while (!pending.empty()) {
+            YamlItem *item = pending.back();
+            pending.pop_back();
+            if (!item || item->owner_ != token)
+                continue;
+            item->owner_ = owner_;
+            if (auto list = Cast<YamlList>(item)) {
+                if (!list->packed()) {
+                    for (auto it = list->begin(), end = list->end(); it != end; ++it)
+                        pending.push_back(it->get());
+                }
+            } else if (auto map = Cast<YamlMap>(item)) {
+                for (auto it = map->begin(), end = map->end(); it != end; ++it)
+                    pending.push_back(it->second.get());
             }
-            return config_list;
-        } else if (YAML::NodeType::Map == node.Type()) {
-            auto config_map = New<YamlMap>();
-            for (auto it = node.begin(), end = node.end(); it != end; ++it) {
-                std::string key = it->first.as<std::string>();
-                config_map->Set(key, ConvertFromYaml(it->second));
+        }
+    }
+
+    void YamlData::Rollback() {
+        in_transaction_ = false;
+        staged_.clear();
+    }
+
+    // the part of key before the first list position depending on the size
+    // of the list, e.g. "@next"; a record then holds the whole list, so that
+    // replaying it twice does not append twice
+    static std::string_view JournalPath(std::string_view key) {
+        size_t start = 0;
+        while (start < key.size()) {
+            size_t end = std::min(key.find('/', start), key.size());
+            if (key[start] == '@' && end - start > 1 &&
+                (key[start + 1] < '0' || key[start + 1] > '9'))
+                return key.substr(0, start ? start - 1 : 0);
+            start = end + 1;
+        }
+        return key;
+    }
+
+    void YamlData::EnableJournal(size_t compact_bytes) {
+        Await();
+        compact_bytes_ = compact_bytes;
+        if (journal_enabled_)
+            return;
+        journal_enabled_ = true;
+        if (file_name_.empty())
+            return;
+        if (modified_) {
+            // earlier writes are only in memory, until the file is saved
+            journal_lost_ = true;
+        } else {
+            ReplayJournal();
+        }
+    }
+
+    void YamlData::DisableJournal() {
+        Await();
+        if (!journal_enabled_)
+            return;
+        FinishCompaction();
+        auto journal = OpenJournal();
+        if (journal && (journal->size() || journal_lost_))
+            SaveToFile(file_name_, format_);
+        journal_enabled_ = false;
+        journal_lost_ = false;
+        journal_.reset();
+    }
+
+    YamlJournal *YamlData::OpenJournal() {
+        if (!journal_enabled_ || file_name_.empty())
+            return nullptr;
+        if (!journal_ || journal_->file_name() != file_name_)
+            journal_ = New<YamlJournal>(file_name_);
+        return journal_.get();
+    }
+
+    void YamlData::Journal(const std::vector<std::string> &keys) {
+        auto journal = OpenJournal();
+        if (!journal)
+            return;
+        YamlJournal::Writes writes;
+        writes.reserve(keys.size());
+        for (const auto &key : keys) {
+            std::string_view path = JournalPath(key);
+            an<YamlItem> hold;
+            const an<YamlItem> *slot = path.empty() ? &root : WalkSlot(path, &hold);
+            writes.emplace_back(std::string(path), slot ? *slot : nullptr);
+        }
+        if (!journal->Append(writes)) {
+            journal_lost_ = true;
+            return;
+        }
+        if (compact_bytes_ && journal->size() >= compact_bytes_)
+            ScheduleCompaction();
+    }
+
+    void YamlData::ReplayJournal() {
+        auto journal = OpenJournal();
+        if (!journal)
+            return;
+        YamlTraceScope trace("replay", file_name_);
+        trace.set_bytes(journal->size());
+        size_t records = journal->Replay([this](const std::string &path, an<YamlItem> item) {
+            bool copied = false;
+            if (!WriteAt(&root, path, item, nullptr, &copied))
+                ALOGW("failed to replay write to '%s'.", path.c_str());
+        }, pack_numbers_);
+        if (records) {
+            ALOGI("replayed %zu journal records of '%s'.", records, file_name_.c_str());
+            ResetIndex();
+        }
+    }
+
+    void YamlData::ScheduleCompaction() {
+        if (compaction_ && compaction_->state() <= YamlLoadTask::kRunning)
+            return;
+        // the snapshot shares the tree, which later writes copy on the way
+        auto snapshot = Clone();
+        auto journal = journal_;
+        size_t offset = journal->size();
+        Format format = format_;
+        YamlSaveOptions options = save_options_;
+        auto job = [snapshot, journal, offset, format, options](const YamlLoadTask &) {
+            return journal->Compact(offset, [&](std::ostream &out) {
+                return snapshot->SaveToStream(out, format, options);
+            });
+        };
+        compaction_ = YamlLoader::instance().Schedule(job, YamlLoader::kLow);
+    }
+
+    void YamlData::FinishCompaction() {
+        if (!compaction_)
+            return;
+        compaction_->Cancel();
+        compaction_->Wait();
+        compaction_.reset();
+    }
+
+    void YamlData::EnableAccessProfile(std::chrono::milliseconds window) {
+        Await();
+        profiling_ = true;
+        profile_window_ = window;
+    }
+
+    bool YamlData::SaveAccessProfile() {
+        Await();
+        return profile_ && profile_->Stop();
+    }
+
+    YamlAccessProfile *YamlData::OpenProfile() {
+        if (!profiling_ || file_name_.empty())
+            return nullptr;
+        if (!profile_ || profile_->file_name() != file_name_) {
+            if (profile_)
+                profile_->Stop();
+            profile_ = New<YamlAccessProfile>(file_name_, profile_window_);
+        }
+        return profile_.get();
+    }
+
+    void YamlData::Preload() {
+        auto profile = OpenProfile();
+        if (!profile)
+            return;
+        YamlTraceScope trace("preload", file_name_);
+        std::vector<std::string> paths;
+        // only an index filled on lookup has paths left to resolve
+        if (index_ && !build_index_ && profile->Load(&paths)) {
+            size_t found = 0;
+            for (const auto &path : paths) {
+                an<YamlItem> hold;
+                auto slot = WalkSlot(path, &hold, false);
+                if (!slot || !*slot)
+                    continue;
+                ++found;
+                index_->Insert(path, YamlPathIndex::Hash(path), *slot);
             }
-            return config_map;
+            trace.set_nodes(found);
+            ALOGI("preloaded %zu of %zu profiled paths of '%s'.",
+                  found, paths.size(), file_name_.c_str());
+        }
+        profile->Start();
+    }
+
+    void YamlData::AttachShared(const an<YamlSharedSegment> &segment) {
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        shared_ = segment;
+        shared_generation_ = 0;
+        shared_nodes_.clear();
+        root.reset();
+        ResetIndex();
+    }
+
+    const an<YamlItem> *YamlData::SharedSlot(std::string_view key, an<YamlItem> *hold) const {
+        std::lock_guard<std::mutex> lock(shared_mutex_);
+        // a new generation invalidates what was built, as a reload would
+        uint64_t generation = shared_->generation();
+        if (generation != shared_generation_) {
+            shared_nodes_.clear();
+            shared_generation_ = generation;
+        }
+        std::string path(key);
+        auto it = shared_nodes_.find(path);
+        if (it != shared_nodes_.end()) {
+            *hold = it->second;
+            return hold;
+        }
+        an<YamlItem> item;
+        if (!shared_->Read(key, &item, &generation)) {
+            Count(YamlStatsCounter::kFailedLookups);
+            return nullptr;
+        }
+        if (generation != shared_generation_) {
+            shared_nodes_.clear();
+            shared_generation_ = generation;
         }
-        return nullptr;
+        *hold = shared_nodes_.emplace(std::move(path), std::move(item)).first->second;
+        return hold;
+    }
+
+    void YamlData::EnableIndex(bool build_now) {
+        if (!index_) {
+            index_.reset(new YamlPathIndex);
+        }
+        build_index_ = build_now;
+        ResetIndex();
+    }
+
+    void YamlData::DisableIndex() {
+        index_.reset();
+        build_index_ = false;
+    }
+
+    void YamlData::ResetIndex() {
+        if (!index_)
+            return;
+        if (build_index_)
+            index_->Build(root);
+        else
+            index_->Clear();
     }
 
     void YamlData::EmitScalar(const std::string &str_value,
@@ -711,38 +2443,111 @@ namespace yaml {
         *emitter << str_value;
     }
 
-    void YamlData::EmitYaml(an<YamlItem> node,
-                              YAML::Emitter *emitter,
-                              int depth) {
-        if (!node || !emitter) return;
-        if (node->type() == YamlItem::kScalar) {
-            auto value = As<YamlValue>(node);
-            EmitScalar(value->str(), emitter);
-        } else if (node->type() == YamlItem::kList) {
-            if (depth >= 3) {
-                *emitter << YAML::Flow;
-            }
-            *emitter << YAML::BeginSeq;
-            auto list = As<YamlList>(node);
-            for (auto it = list->begin(), end = list->end(); it != end; ++it) {
-                EmitYaml(*it, emitter, depth + 1);
-            }
-            *emitter << YAML::EndSeq;
-        } else if (node->type() == YamlItem::kMap) {
-            if (depth >= 3) {
-                *emitter << YAML::Flow;
-            }
-            *emitter << YAML::BeginMap;
-            auto map = As<YamlMap>(node);
-            for (auto it = map->begin(), end = map->end(); it != end; ++it) {
-                if (!it->second || it->second->type() == YamlItem::kNull)
-                    continue;
-                *emitter << YAML::Key;
-                EmitScalar(it->first, emitter);
-                *emitter << YAML::Value;
-                EmitYaml(it->second, emitter, depth + 1);
+    void YamlData::CollectAnchors(const YamlItem *root, EmitContext *context) const {
+        // count references to every node, not descending into a node twice
+        std::unordered_map<const YamlItem *, int> refs;
+        for (YamlDepthFirstIterator it(root), end; it != end; ++it) {
+            if (it->item && ++refs[it->item] > 1)
+                it.SkipChildren();
+        }
+        // nodes shared by the source keep their anchor names. repeated
+        // scalars are written out again unless the source anchored them
+        for (const auto &ref : refs) {
+            if (ref.second < 2)
+                continue;
+            auto name = anchor_names_.find(ref.first);
+            if (name != anchor_names_.end())
+                context->nodes[ref.first].name = name->second;
+            else if (ref.first->type() != YamlItem::kScalar)
+                context->nodes[ref.first];
+        }
+    }
+
+    class YamlData::EmitVisitor : public YamlVisitor {
+    public:
+        EmitVisitor(YAML::Emitter *emitter, EmitContext *context)
+                : emitter_(emitter), context_(context) {
+        }
+
+        void VisitScalar(const YamlWalkStep &step, const YamlValue &value) override {
+            if (Prefix(step))
+                EmitScalar(value.str(), emitter_);
+        }
+
+        bool BeginList(const YamlWalkStep &step, const YamlList &list) override {
+            if (!Prefix(step))
+                return false;
+            if (int(step.depth) >= context_->flow_depth) {
+                *emitter_ << YAML::Flow;
+            }
+            *emitter_ << YAML::BeginSeq;
+            if (auto packed = list.packed_array()) {
+                for (size_t i = 0, size = packed->size(); i < size; ++i) {
+                    EmitScalar(packed->Format(i), emitter_);
+                }
+                context_->emitted += packed->size();
             }
-            *emitter << YAML::EndMap;
+            return true;
+        }
+
+        void EndList(const YamlWalkStep &, const YamlList &) override {
+            *emitter_ << YAML::EndSeq;
         }
+
+        bool BeginMap(const YamlWalkStep &step, const YamlMap &) override {
+            if (!Prefix(step))
+                return false;
+            if (int(step.depth) >= context_->flow_depth) {
+                *emitter_ << YAML::Flow;
+            }
+            *emitter_ << YAML::BeginMap;
+            return true;
+        }
+
+        void EndMap(const YamlWalkStep &, const YamlMap &) override {
+            *emitter_ << YAML::EndMap;
+        }
+
+    private:
+        // writes the key of a map entry, and the anchor of a shared node;
+        // false if the node was written already and an alias took its place
+        bool Prefix(const YamlWalkStep &step) {
+            ++context_->emitted;
+            if (step.key) {
+                *emitter_ << YAML::Key;
+                EmitScalar(*step.key, emitter_);
+                *emitter_ << YAML::Value;
+            }
+            auto anchor = context_->nodes.find(step.item);
+            if (anchor == context_->nodes.end())
+                return true;
+            EmitAnchor &a = anchor->second;
+            if (a.emitted) {
+                *emitter_ << YAML::Alias(a.name);
+                return false;
+            }
+            // names are numbered in document order so output is stable
+            if (a.name.empty() || !context_->used.insert(a.name).second) {
+                do {
+                    a.name = std::to_string(++context_->next_id);
+                } while (!context_->used.insert(a.name).second);
+            }
+            a.emitted = true;
+            *emitter_ << YAML::Anchor(a.name);
+            return true;
+        }
+
+        YAML::Emitter *emitter_;
+        EmitContext *context_;
+    };
+
+    void YamlData::EmitYaml(const an<YamlItem> &root,
+                            YAML::Emitter *emitter,
+                            EmitContext *context) const {
+        if (!root || !emitter) return;
+        // null nodes are left out, map entries and list elements alike
+        EmitVisitor visitor(emitter, context);
+        if (!WalkYaml(root, &visitor, limits_.max_depth))
+            throw YAML::EmitterException("document exceeds max_depth");
     }
 }  // namespace yaml
@@ -0,0 +1,135 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <yaml_builder.h>
+
+namespace yaml {
+
+    YamlBuilder &YamlBuilder::BeginList(size_t reserve) {
+        auto list = New<YamlList>();
+        list->Reserve(reserve);
+        YamlItem *node = list.get();
+        if (Add(std::move(list)))
+            stack_.push_back(Frame{node, std::string(), false});
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::BeginMap() {
+        auto map = New<YamlMap>();
+        YamlItem *node = map.get();
+        if (Add(std::move(map)))
+            stack_.push_back(Frame{node, std::string(), false});
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::End() {
+        if (stack_.empty())
+            return Fail("nothing to end");
+        if (stack_.back().has_key)
+            return Fail("key without a value");
+        stack_.pop_back();
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::Key(std::string key) {
+        if (stack_.empty() || stack_.back().node->type() != YamlItem::kMap)
+            return Fail("key outside of a map");
+        if (stack_.back().has_key)
+            return Fail("key without a value");
+        stack_.back().key = std::move(key);
+        stack_.back().has_key = true;
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::Value(std::string value) {
+        Add(New<YamlValue>(std::move(value)));
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::Null() {
+        Add(nullptr);
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::Item(an<YamlItem> item) {
+        Add(std::move(item));
+        return *this;
+    }
+
+    YamlBuilder &YamlBuilder::SortedEntries(Entries &&entries) {
+        if (stack_.empty() || stack_.back().node->type() != YamlItem::kMap)
+            return Fail("entries outside of a map");
+        if (stack_.back().has_key)
+            return Fail("key without a value");
+        auto map = static_cast<YamlMap *>(stack_.back().node);
+        for (auto &entry : entries) {
+            // a run that overlaps keys added before still lands in place
+            if (!map->Append(std::move(entry.first), entry.second))
+                map->Set(std::move(entry.first), std::move(entry.second));
+        }
+        entries.clear();
+        return *this;
+    }
+
+    an<YamlItem> YamlBuilder::Release() {
+        an<YamlItem> root;
+        if (!ok_)
+            ALOGE("failed to build config tree.");
+        else if (!stack_.empty())
+            ALOGE("failed to build config tree: %zu lists or maps not ended.", stack_.size());
+        else
+            root = std::move(root_);
+        root_.reset();
+        has_root_ = false;
+        stack_.clear();
+        ok_ = true;
+        return root;
+    }
+
+    bool YamlBuilder::Finish(Yaml *config) {
+        bool complete = ok_ && stack_.empty();
+        an<YamlItem> root = Release();
+        if (!complete || !config)
+            return false;
+        *config = root;
+        return true;
+    }
+
+    YamlBuilder &YamlBuilder::Fail(const char *message) {
+        if (ok_)
+            ALOGE("config builder: %s.", message);
+        ok_ = false;
+        return *this;
+    }
+
+    bool YamlBuilder::Add(an<YamlItem> item) {
+        if (!ok_)
+            return false;
+        if (stack_.empty()) {
+            if (has_root_) {
+                Fail("more than one root");
+                return false;
+            }
+            root_ = std::move(item);
+            has_root_ = true;
+            return true;
+        }
+        Frame &top = stack_.back();
+        if (top.node->type() == YamlItem::kList) {
+            static_cast<YamlList *>(top.node)->Append(std::move(item));
+            return true;
+        }
+        if (!top.has_key) {
+            Fail("value in a map without a key");
+            return false;
+        }
+        auto map = static_cast<YamlMap *>(top.node);
+        // entries in key order go to the end without a search
+        if (!map->Append(std::move(top.key), item))
+            map->Set(std::move(top.key), std::move(item));
+        top.has_key = false;
+        return true;
+    }
+
+}  // namespace yaml
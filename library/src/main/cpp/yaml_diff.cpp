@@ -0,0 +1,177 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <yaml_diff.h>
+
+namespace yaml {
+
+    namespace {
+
+        // compares two trees depth first, with the lists and maps being
+        // compared on an explicit stack rather than the native one
+        class Differ {
+        public:
+            explicit Differ(YamlDiff *diff) : diff_(diff) {
+            }
+
+            void Run(const YamlItem *from, const YamlItem *to);
+
+        private:
+            // a pair of lists or maps whose children are being compared
+            struct Frame {
+                const YamlList *from_list = nullptr;
+                const YamlList *to_list = nullptr;
+                // elements before index and from the ends on are equal
+                size_t index = 0;
+                size_t from_end = 0;
+                size_t to_end = 0;
+                YamlMap::ConstIterator a, a_end, b, b_end;
+                size_t path_length = 0;
+            };
+
+            // records a difference at path_, or stacks the pair to compare
+            // their children
+            void Compare(const YamlItem *from, const YamlItem *to);
+
+            // skips the common head and tail of two lists, so that an
+            // insertion or removal is reported as such rather than as
+            // changes to every element after it
+            void Align(Frame *frame);
+
+            // the next pair of children, with the path set to theirs
+            bool Next(Frame *frame, const YamlItem **from, const YamlItem **to);
+
+            void Push(std::string_view key) {
+                if (!path_.empty())
+                    path_.push_back('/');
+                path_.append(key.data(), key.size());
+            }
+
+            void Record(std::vector<std::string> *paths) {
+                paths->push_back(path_);
+            }
+
+            YamlDiff *diff_;
+            std::string path_;
+            std::vector<Frame> stack_;
+        };
+
+        void Differ::Run(const YamlItem *from, const YamlItem *to) {
+            Compare(from, to);
+            while (!stack_.empty()) {
+                const YamlItem *a = nullptr;
+                const YamlItem *b = nullptr;
+                if (Next(&stack_.back(), &a, &b))
+                    Compare(a, b);
+                else
+                    stack_.pop_back();
+            }
+        }
+
+        void Differ::Compare(const YamlItem *from, const YamlItem *to) {
+            if (from == to)
+                return;
+            if (!from || !to) {
+                Record(from ? &diff_->removed : &diff_->added);
+                return;
+            }
+            if (from->hash() == to->hash())
+                return;
+            Frame frame;
+            frame.path_length = path_.length();
+            if (from->type() != to->type()) {
+                Record(&diff_->changed);
+                return;
+            } else if (auto list = Cast<YamlList>(from)) {
+                frame.from_list = list;
+                frame.to_list = Cast<YamlList>(to);
+                Align(&frame);
+            } else if (auto map = Cast<YamlMap>(from)) {
+                auto other = Cast<YamlMap>(to);
+                frame.a = map->begin();
+                frame.a_end = map->end();
+                frame.b = other->begin();
+                frame.b_end = other->end();
+            } else {
+                Record(&diff_->changed);
+                return;
+            }
+            stack_.push_back(frame);
+        }
+
+        static bool SameElement(const YamlList *from, size_t i, const YamlList *to, size_t j) {
+            const YamlItem *a = from->FindAt(i)->get();
+            const YamlItem *b = to->FindAt(j)->get();
+            return a == b || (a && b && a->hash() == b->hash());
+        }
+
+        void Differ::Align(Frame *frame) {
+            const YamlList *from = frame->from_list;
+            const YamlList *to = frame->to_list;
+            size_t &head = frame->index;
+            size_t &from_end = frame->from_end;
+            size_t &to_end = frame->to_end;
+            from_end = from->size();
+            to_end = to->size();
+            while (head < from_end && head < to_end && SameElement(from, head, to, head))
+                ++head;
+            while (head < from_end && head < to_end &&
+                   SameElement(from, from_end - 1, to, to_end - 1)) {
+                --from_end;
+                --to_end;
+            }
+        }
+
+        bool Differ::Next(Frame *frame, const YamlItem **from, const YamlItem **to) {
+            path_.resize(frame->path_length);
+            if (frame->from_list) {
+                // what is left in between is compared by index
+                size_t i = frame->index++;
+                if (i >= frame->from_end && i >= frame->to_end)
+                    return false;
+                Push("@" + std::to_string(i));
+                *from = i < frame->from_end ? frame->from_list->FindAt(i)->get() : nullptr;
+                *to = i < frame->to_end ? frame->to_list->FindAt(i)->get() : nullptr;
+                return true;
+            }
+            // merges the sorted entries of both maps
+            auto &a = frame->a;
+            auto &b = frame->b;
+            if (a == frame->a_end && b == frame->b_end)
+                return false;
+            int order = a == frame->a_end ? 1 : b == frame->b_end ? -1 :
+                                                a->first.compare(b->first);
+            if (order < 0) {
+                Push(a->first);
+                *from = a->second.get();
+                ++a;
+            } else if (order > 0) {
+                Push(b->first);
+                *to = b->second.get();
+                ++b;
+            } else {
+                Push(a->first);
+                *from = a->second.get();
+                *to = b->second.get();
+                ++a;
+                ++b;
+            }
+            return true;
+        }
+
+    }  // namespace
+
+    void DiffYaml(const YamlItem *from, const YamlItem *to, YamlDiff *diff) {
+        if (!diff)
+            return;
+        Differ differ(diff);
+        differ.Run(from, to);
+    }
+
+    void DiffYaml(const Yaml &from, const Yaml &to, YamlDiff *diff) {
+        DiffYaml(from.PeekItem(""), to.PeekItem(""), diff);
+    }
+
+}  // namespace yaml
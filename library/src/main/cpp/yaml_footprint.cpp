@@ -0,0 +1,203 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <yaml_data.h>
+#include <yaml_footprint.h>
+
+namespace yaml {
+
+    namespace {
+
+        // make_shared places the object next to a vptr and two reference counts
+        const size_t kControlBlockSize = sizeof(void *) + 2 * sizeof(int);
+
+        // red-black tree node: color, parent, left and right links
+        const size_t kMapNodeOverhead = 4 * sizeof(void *);
+
+        // heap bytes owned by a string; short strings live inside the object
+        size_t HeapBytes(const std::string &str) {
+            const char *data = str.data();
+            const char *self = reinterpret_cast<const char *>(&str);
+            if (data >= self && data < self + sizeof(str))
+                return 0;
+            return str.capacity() + 1;
+        }
+
+        // sizes nodes depth first without recursion; a list or map is
+        // summed up once its children are
+        class FootprintWalker : public YamlVisitor {
+        public:
+            explicit FootprintWalker(YamlFootprint *footprint)
+                    : footprint_(footprint) {
+            }
+
+            void VisitNull(const YamlWalkStep &step) override;
+
+            void VisitScalar(const YamlWalkStep &step, const YamlValue &value) override;
+
+            bool BeginList(const YamlWalkStep &step, const YamlList &list) override;
+
+            void EndList(const YamlWalkStep &step, const YamlList &) override {
+                Leave(step);
+            }
+
+            bool BeginMap(const YamlWalkStep &step, const YamlMap &map) override;
+
+            void EndMap(const YamlWalkStep &step, const YamlMap &) override {
+                Leave(step);
+            }
+
+        private:
+            // a list or map whose children are being walked
+            struct Frame {
+                YamlItem::ValueType type;
+                size_t own;
+                size_t children;
+                // bytes of its entry in the parent map
+                size_t entry;
+            };
+
+            size_t MeasureString(const std::string &str);
+
+            // counts the entry of a map child to its parent; false if the
+            // node was counted before or is null
+            bool Enter(const YamlWalkStep &step, size_t *entry);
+
+            // a node of own bytes and its subtree, counted to its parent
+            void Count(const YamlWalkStep &step, YamlItem::ValueType type, size_t own,
+                       size_t subtree, size_t entry);
+
+            // a subtree counted to its parent, e.g. one counted before as 0
+            void AddToParent(const YamlWalkStep &step, size_t subtree, size_t entry);
+
+            void Leave(const YamlWalkStep &step);
+
+            YamlFootprint *footprint_;
+            hash_set<const YamlItem *> visited_;
+            hash_map<std::string, size_t> strings_;
+            std::vector<Frame> stack_;
+        };
+
+        size_t FootprintWalker::MeasureString(const std::string &str) {
+            size_t heap = HeapBytes(str);
+            footprint_->string_bytes += heap;
+            if (heap)
+                footprint_->string_slack_bytes += str.capacity() - str.size();
+            // interning would free the heap copies after the first
+            if (++strings_[str] > 1) {
+                ++footprint_->duplicate_strings;
+                footprint_->duplicate_string_bytes += heap;
+            }
+            return heap;
+        }
+
+        bool FootprintWalker::Enter(const YamlWalkStep &step, size_t *entry) {
+            *entry = 0;
+            if (step.key) {
+                *entry = kMapNodeOverhead + sizeof(YamlMap::Map::value_type);
+                footprint_->map_entry_bytes += *entry;
+                *entry += MeasureString(*step.key);
+                stack_.back().own += *entry;
+            }
+            if (!step.item) {
+                AddToParent(step, 0, *entry);
+                return false;
+            }
+            if (!visited_.insert(step.item).second) {
+                ++footprint_->shared_nodes;
+                AddToParent(step, 0, *entry);
+                return false;
+            }
+            footprint_->control_block_bytes += kControlBlockSize;
+            return true;
+        }
+
+        void FootprintWalker::AddToParent(const YamlWalkStep &step, size_t subtree,
+                                          size_t entry) {
+            if (!step.depth)
+                return;
+            stack_.back().children += subtree;
+            if (step.depth == 1 && step.key)
+                footprint_->top_level_bytes[*step.key] = entry + subtree;
+        }
+
+        void FootprintWalker::Count(const YamlWalkStep &step, YamlItem::ValueType type,
+                                    size_t own, size_t subtree, size_t entry) {
+            ++footprint_->nodes[type];
+            footprint_->bytes[type] += own;
+            footprint_->total_bytes += own;
+            AddToParent(step, subtree, entry);
+        }
+
+        void FootprintWalker::VisitNull(const YamlWalkStep &step) {
+            size_t entry = 0;
+            if (!Enter(step, &entry))
+                return;
+            size_t own = kControlBlockSize + sizeof(YamlItem);
+            Count(step, YamlItem::kNull, own, own, entry);
+        }
+
+        void FootprintWalker::VisitScalar(const YamlWalkStep &step, const YamlValue &value) {
+            size_t entry = 0;
+            if (!Enter(step, &entry))
+                return;
+            size_t own = kControlBlockSize + sizeof(YamlValue) + MeasureString(value.str());
+            Count(step, YamlItem::kScalar, own, own, entry);
+        }
+
+        bool FootprintWalker::BeginList(const YamlWalkStep &step, const YamlList &list) {
+            size_t entry = 0;
+            if (!Enter(step, &entry))
+                return false;
+            size_t own = kControlBlockSize + sizeof(YamlList);
+            // the walk does not descend into a packed list, whose elements
+            // are not nodes until materialized, which ends the packing
+            if (auto packed = list.packed_array()) {
+                size_t bytes = sizeof(YamlPackedArray) + kControlBlockSize +
+                               packed->ints.capacity() * sizeof(int64_t) +
+                               packed->doubles.capacity() * sizeof(double);
+                own += bytes;
+                footprint_->list_buffer_bytes += bytes;
+            } else {
+                size_t buffer = list.capacity() * sizeof(an<YamlItem>);
+                own += buffer;
+                footprint_->list_buffer_bytes += buffer;
+                footprint_->list_slack_bytes +=
+                        (list.capacity() - list.size()) * sizeof(an<YamlItem>);
+            }
+            stack_.push_back(Frame{YamlItem::kList, own, 0, entry});
+            return true;
+        }
+
+        bool FootprintWalker::BeginMap(const YamlWalkStep &step, const YamlMap &) {
+            size_t entry = 0;
+            if (!Enter(step, &entry))
+                return false;
+            stack_.push_back(Frame{YamlItem::kMap, kControlBlockSize + sizeof(YamlMap), 0, entry});
+            return true;
+        }
+
+        void FootprintWalker::Leave(const YamlWalkStep &step) {
+            Frame frame = stack_.back();
+            stack_.pop_back();
+            Count(step, frame.type, frame.own, frame.own + frame.children, frame.entry);
+        }
+
+    }  // namespace
+
+    void MeasureFootprint(const an<YamlItem> &root, YamlFootprint *footprint) {
+        if (!footprint)
+            return;
+        *footprint = YamlFootprint();
+        FootprintWalker walker(footprint);
+        WalkYaml(root, &walker);
+    }
+
+    void Yaml::GetFootprint(YamlFootprint *footprint) const {
+        an<YamlItem> hold;
+        auto slot = data_->FindSlot("", &hold);
+        MeasureFootprint(slot ? *slot : nullptr, footprint);
+    }
+
+}  // namespace yaml
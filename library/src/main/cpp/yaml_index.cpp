@@ -0,0 +1,115 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <mutex>
+#include <yaml_index.h>
+#include <yaml_walk.h>
+
+namespace yaml {
+
+    an<YamlItem> YamlPathIndex::Find(std::string_view path, size_t hash) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto range = buckets_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->first == path)
+                return it->second->second;
+        }
+        return nullptr;
+    }
+
+    void YamlPathIndex::Insert(std::string_view path, size_t hash,
+                               const an<YamlItem> &item) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto range = buckets_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->first == path) {
+                it->second->second = item;
+                return;
+            }
+        }
+        auto entry = paths_.emplace(std::string(path), item).first;
+        buckets_.emplace(hash, entry);
+    }
+
+    void YamlPathIndex::Erase(Paths::iterator entry) {
+        auto range = buckets_.equal_range(Hash(entry->first));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == entry) {
+                buckets_.erase(it);
+                break;
+            }
+        }
+        paths_.erase(entry);
+    }
+
+    void YamlPathIndex::InvalidatePrefix(std::string_view prefix) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (prefix.empty()) {
+            paths_.clear();
+            buckets_.clear();
+            return;
+        }
+        auto it = paths_.find(prefix);
+        if (it != paths_.end())
+            Erase(it);
+        // the paths below prefix sort between "prefix/" and "prefix0"
+        std::string bound(prefix);
+        bound.push_back('/');
+        it = paths_.lower_bound(bound);
+        bound.back() = '/' + 1;
+        auto last = paths_.lower_bound(bound);
+        while (it != last)
+            Erase(it++);
+    }
+
+    void YamlPathIndex::InvalidateAncestors(std::string_view path) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (size_t end = path.find('/'); end != std::string_view::npos;
+             end = path.find('/', end + 1)) {
+            auto it = paths_.find(path.substr(0, end));
+            if (it != paths_.end())
+                Erase(it);
+        }
+    }
+
+    void YamlPathIndex::Clear() {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        paths_.clear();
+        buckets_.clear();
+    }
+
+    void YamlPathIndex::Build(const an<YamlItem> &root) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        paths_.clear();
+        buckets_.clear();
+        if (!root)
+            return;
+        std::string path;
+        // where the path of the node at each depth ends. the walk skips
+        // packed elements, which are materialized only if looked up
+        std::vector<size_t> ends(1, 0);
+        YamlDepthFirstIterator it(root), end;
+        for (++it; it != end; ++it) {
+            if (!it->item)
+                continue;
+            path.resize(ends[it->depth - 1]);
+            if (it->depth > 1)
+                path.push_back('/');
+            if (it->key)
+                path.append(*it->key);
+            else
+                path.append("@").append(std::to_string(it->index));
+            ends.resize(it->depth + 1);
+            ends[it->depth] = path.length();
+            auto entry = paths_.emplace_hint(paths_.end(), path, *it->slot);
+            buckets_.emplace(Hash(path), entry);
+        }
+    }
+
+    size_t YamlPathIndex::size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return paths_.size();
+    }
+
+}  // namespace yaml
@@ -0,0 +1,171 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <iterator>
+#include <boost/filesystem.hpp>
+#include <yaml_journal.h>
+#include <yaml_json.h>
+
+namespace yaml {
+
+    YamlJournal::YamlJournal(const std::string &file_name)
+            : file_name_(file_name), path_(file_name + ".journal") {
+        boost::system::error_code ec;
+        auto size = boost::filesystem::file_size(path_, ec);
+        size_ = ec ? 0 : size_t(size);
+    }
+
+    size_t YamlJournal::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return size_;
+    }
+
+    bool YamlJournal::OpenForAppend() {
+        if (out_.is_open())
+            return true;
+        out_.open(path_.c_str(), std::ios::binary | std::ios::app);
+        if (!out_.good()) {
+            ALOGE("failed to open journal '%s'.", path_.c_str());
+            out_.close();
+            return false;
+        }
+        return true;
+    }
+
+    bool YamlJournal::Append(const Writes &writes) {
+        auto record = New<YamlList>();
+        for (const auto &write : writes) {
+            record->Append(New<YamlValue>(write.first));
+            record->Append(write.second);
+        }
+        std::string line;
+        YamlJsonWriter().Write(record.get(), &line);
+        line.push_back('\n');
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!OpenForAppend())
+            return false;
+        // flushed at once, a record is either whole in the file or torn
+        // at its end, which Replay() cuts off
+        if (!out_.write(line.data(), line.size()) || !out_.flush()) {
+            ALOGE("failed to append to journal '%s'.", path_.c_str());
+            out_.close();
+            return false;
+        }
+        size_ += line.size();
+        return true;
+    }
+
+    size_t YamlJournal::Replay(const std::function<void(const std::string &path,
+                                                        an<YamlItem> item)> &apply,
+                               bool pack_numbers) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_.close();
+        std::ifstream in(path_.c_str(), std::ios::binary);
+        if (!in.good()) {
+            size_ = 0;
+            return 0;
+        }
+        std::string source((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+        in.close();
+        size_t records = 0;
+        size_t start = 0;
+        while (start < source.size()) {
+            size_t end = source.find('\n', start);
+            if (end == std::string::npos)
+                break;
+            YamlJsonReader reader;
+            reader.set_pack_numbers(pack_numbers);
+            an<YamlItem> record;
+            std::string error;
+            auto writes = As<YamlList>(
+                    reader.Parse(std::string_view(source).substr(start, end - start),
+                                 &record, &error) ? record : nullptr);
+            if (!writes || writes->size() % 2) {
+                break;
+            }
+            for (size_t i = 0; i < writes->size(); i += 2) {
+                auto path = As<YamlValue>(writes->GetAt(i));
+                apply(path ? path->str() : std::string(), writes->GetAt(i + 1));
+            }
+            ++records;
+            start = end + 1;
+        }
+        if (start < source.size()) {
+            ALOGW("dropped %zu bytes of broken journal '%s'.",
+                  source.size() - start, path_.c_str());
+            boost::system::error_code ec;
+            boost::filesystem::resize_file(path_, start, ec);
+            if (ec) {
+                ALOGE("failed to truncate journal '%s'.", path_.c_str());
+            }
+        }
+        size_ = start;
+        return records;
+    }
+
+    bool YamlJournal::Reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out_.close();
+        size_ = 0;
+        boost::system::error_code ec;
+        boost::filesystem::remove(path_, ec);
+        if (ec) {
+            ALOGE("failed to remove journal '%s'.", path_.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool YamlJournal::Compact(size_t offset,
+                              const std::function<bool(std::ostream &out)> &save) {
+        // the new file is written aside, then swapped in whole
+        std::string temp_file = file_name_ + ".tmp";
+        bool saved;
+        {
+            std::ofstream out(temp_file.c_str(), std::ios::binary);
+            saved = out.good() && save(out) && out.flush();
+        }
+        boost::system::error_code ec;
+        if (!saved) {
+            ALOGE("failed to compact journal of '%s'.", file_name_.c_str());
+            boost::filesystem::remove(temp_file, ec);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        boost::filesystem::rename(temp_file, file_name_, ec);
+        if (ec) {
+            ALOGE("failed to replace '%s': %s", file_name_.c_str(), ec.message().c_str());
+            boost::filesystem::remove(temp_file, ec);
+            return false;
+        }
+        // a crash from here on leaves records the file holds already,
+        // which replay harmlessly
+        out_.close();
+        std::string tail;
+        {
+            std::ifstream in(path_.c_str(), std::ios::binary);
+            in.seekg(std::streamoff(offset));
+            tail.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        std::string temp_journal = path_ + ".tmp";
+        {
+            std::ofstream out(temp_journal.c_str(), std::ios::binary);
+            out.write(tail.data(), tail.size());
+            if (!out.flush()) {
+                ALOGE("failed to rewrite journal '%s'.", path_.c_str());
+                return false;
+            }
+        }
+        boost::filesystem::rename(temp_journal, path_, ec);
+        if (ec) {
+            ALOGE("failed to rewrite journal '%s'.", path_.c_str());
+            return false;
+        }
+        size_ = tail.size();
+        ALOGI("compacted journal of '%s', %zu bytes left.", file_name_.c_str(), size_);
+        return true;
+    }
+
+}  // namespace yaml
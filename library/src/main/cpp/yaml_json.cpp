@@ -0,0 +1,418 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <yaml_json.h>
+
+namespace yaml {
+
+    namespace {
+
+        // bytes that end a run of plain string content: quote, backslash
+        // and control characters
+        struct StringStops {
+            bool stop[256];
+
+            StringStops() {
+                for (int c = 0; c < 256; ++c) {
+                    stop[c] = c < 0x20 || c == '"' || c == '\\';
+                }
+            }
+        };
+
+        const StringStops kStringStops;
+
+        inline bool IsDigit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        int HexValue(char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        void AppendUtf8(uint32_t cp, std::string *out) {
+            if (cp < 0x80) {
+                out->push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                out->push_back(static_cast<char>(0xc0 | (cp >> 6)));
+                out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else if (cp < 0x10000) {
+                out->push_back(static_cast<char>(0xe0 | (cp >> 12)));
+                out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else {
+                out->push_back(static_cast<char>(0xf0 | (cp >> 18)));
+                out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+                out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+        }
+
+        // length of the JSON number at p, or 0
+        size_t ScanNumber(const char *p, const char *end) {
+            const char *start = p;
+            if (p < end && *p == '-') ++p;
+            if (p == end) return 0;
+            if (*p == '0') {
+                ++p;
+            } else if (IsDigit(*p)) {
+                while (p < end && IsDigit(*p)) ++p;
+            } else {
+                return 0;
+            }
+            if (p < end && *p == '.') {
+                ++p;
+                if (p == end || !IsDigit(*p)) return 0;
+                while (p < end && IsDigit(*p)) ++p;
+            }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                ++p;
+                if (p < end && (*p == '+' || *p == '-')) ++p;
+                if (p == end || !IsDigit(*p)) return 0;
+                while (p < end && IsDigit(*p)) ++p;
+            }
+            return p - start;
+        }
+
+        inline bool Matches(const char *p, const char *end, const char *word, size_t n) {
+            return size_t(end - p) >= n && std::memcmp(p, word, n) == 0;
+        }
+
+    }  // namespace
+
+// YamlJsonReader members
+
+    bool YamlJsonReader::Fail(const char *message) {
+        if (error_) {
+            *error_ = std::string(message) + " at offset " +
+                      std::to_string(p_ - begin_);
+        }
+        return false;
+    }
+
+    bool YamlJsonReader::Enter(size_t depth) {
+        if (!budget_ || budget_->EnterNode(depth))
+            return true;
+        return Fail(budget_->error().c_str());
+    }
+
+    void YamlJsonReader::SkipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+            ++p_;
+    }
+
+    bool YamlJsonReader::ParseString(std::string *out) {
+        // p_ is at the opening quote
+        ++p_;
+        out->clear();
+        while (true) {
+            const char *run = p_;
+            while (p_ < end_ && !kStringStops.stop[static_cast<unsigned char>(*p_)])
+                ++p_;
+            out->append(run, p_ - run);
+            if (p_ == end_)
+                return Fail("unterminated string");
+            char c = *p_++;
+            if (c == '"') {
+                if (budget_ && !budget_->CheckScalar(out->size()))
+                    return Fail(budget_->error().c_str());
+                return true;
+            }
+            if (c != '\\')
+                return Fail("control character in string");
+            if (p_ == end_)
+                return Fail("unterminated string");
+            switch (*p_++) {
+                case '"': out->push_back('"'); break;
+                case '\\': out->push_back('\\'); break;
+                case '/': out->push_back('/'); break;
+                case 'b': out->push_back('\b'); break;
+                case 'f': out->push_back('\f'); break;
+                case 'n': out->push_back('\n'); break;
+                case 'r': out->push_back('\r'); break;
+                case 't': out->push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    for (int pass = 0; pass < 2; ++pass) {
+                        if (end_ - p_ < 4)
+                            return Fail("truncated unicode escape");
+                        uint32_t unit = 0;
+                        for (int i = 0; i < 4; ++i) {
+                            int h = HexValue(p_[i]);
+                            if (h < 0)
+                                return Fail("bad unicode escape");
+                            unit = (unit << 4) | h;
+                        }
+                        p_ += 4;
+                        if (pass == 0) {
+                            cp = unit;
+                            // a high surrogate must be followed by a low one
+                            if (unit < 0xd800 || unit > 0xdbff)
+                                break;
+                            if (!Matches(p_, end_, "\\u", 2))
+                                return Fail("unpaired surrogate");
+                            p_ += 2;
+                        } else {
+                            if (unit < 0xdc00 || unit > 0xdfff)
+                                return Fail("unpaired surrogate");
+                            cp = 0x10000 + ((cp - 0xd800) << 10) + (unit - 0xdc00);
+                        }
+                    }
+                    AppendUtf8(cp, out);
+                    break;
+                }
+                default:
+                    return Fail("bad escape");
+            }
+        }
+    }
+
+    bool YamlJsonReader::ParseScalar(an<YamlItem> *out) {
+        if (*p_ == '"') {
+            std::string text;
+            if (!ParseString(&text))
+                return false;
+            *out = New<YamlValue>(std::move(text));
+        } else if (Matches(p_, end_, "true", 4)) {
+            p_ += 4;
+            *out = New<YamlValue>("true");
+        } else if (Matches(p_, end_, "false", 5)) {
+            p_ += 5;
+            *out = New<YamlValue>("false");
+        } else if (Matches(p_, end_, "null", 4)) {
+            p_ += 4;
+            out->reset();
+            ++nodes_[YamlItem::kNull];
+            return true;
+        } else {
+            size_t n = ScanNumber(p_, end_);
+            if (!n)
+                return Fail("unexpected character");
+            if (budget_ && !budget_->CheckScalar(n))
+                return Fail(budget_->error().c_str());
+            *out = New<YamlValue>(std::string(p_, n));
+            p_ += n;
+        }
+        ++nodes_[YamlItem::kScalar];
+        return true;
+    }
+
+    bool YamlJsonReader::Parse(std::string_view source, an<YamlItem> *root,
+                               std::string *error, YamlLoadBudget *budget) {
+        begin_ = p_ = source.data();
+        end_ = p_ + source.size();
+        error_ = error;
+        budget_ = budget;
+        std::fill(std::begin(nodes_), std::end(nodes_), 0);
+        // containers being filled; an explicit stack keeps deep documents
+        // off the native stack
+        struct Frame {
+            an<YamlItem> node;
+            std::string key;
+        };
+        std::vector<Frame> stack;
+        an<YamlItem> value;
+        SkipSpace();
+        while (true) {
+            // parse a value
+            if (p_ == end_)
+                return Fail("unexpected end of input");
+            if (!Enter(stack.size()))
+                return false;
+            bool complete = true;
+            if (*p_ == '{' || *p_ == '[') {
+                bool is_map = *p_ == '{';
+                ++p_;
+                SkipSpace();
+                an<YamlItem> container;
+                if (is_map)
+                    container = New<YamlMap>();
+                else
+                    container = New<YamlList>();
+                ++nodes_[container->type()];
+                if (p_ < end_ && *p_ == (is_map ? '}' : ']')) {
+                    ++p_;
+                    value = container;
+                } else {
+                    stack.push_back(Frame{container, std::string()});
+                    if (is_map) {
+                        if (p_ == end_ || *p_ != '"')
+                            return Fail("expected key");
+                        if (!ParseString(&stack.back().key))
+                            return false;
+                        SkipSpace();
+                        if (p_ == end_ || *p_ != ':')
+                            return Fail("expected ':'");
+                        ++p_;
+                    }
+                    SkipSpace();
+                    complete = false;
+                }
+            } else if (!ParseScalar(&value)) {
+                return false;
+            }
+            // store completed values, closing containers as they end
+            while (complete) {
+                if (stack.empty()) {
+                    SkipSpace();
+                    if (p_ != end_)
+                        return Fail("trailing characters");
+                    *root = value;
+                    return true;
+                }
+                Frame &top = stack.back();
+                bool is_map = top.node->type() == YamlItem::kMap;
+                if (is_map)
+                    static_cast<YamlMap *>(top.node.get())->Set(std::move(top.key),
+                                                                std::move(value));
+                else
+                    static_cast<YamlList *>(top.node.get())->Append(std::move(value));
+                SkipSpace();
+                if (p_ == end_)
+                    return Fail("unexpected end of input");
+                if (*p_ == ',') {
+                    ++p_;
+                    SkipSpace();
+                    if (is_map) {
+                        if (p_ == end_ || *p_ != '"')
+                            return Fail("expected key");
+                        if (!ParseString(&top.key))
+                            return false;
+                        SkipSpace();
+                        if (p_ == end_ || *p_ != ':')
+                            return Fail("expected ':'");
+                        ++p_;
+                        SkipSpace();
+                    }
+                    complete = false;
+                } else if (*p_ == (is_map ? '}' : ']')) {
+                    ++p_;
+                    if (!is_map && pack_numbers_) {
+                        auto list = static_cast<YamlList *>(top.node.get());
+                        if (list->size() >= YamlList::kPackThreshold)
+                            list->Pack();
+                    }
+                    value = top.node;
+                    stack.pop_back();
+                } else {
+                    return Fail(is_map ? "expected ',' or '}'" : "expected ',' or ']'");
+                }
+            }
+        }
+    }
+
+// YamlJsonWriter members
+
+    bool YamlJsonWriter::Write(const YamlItem *root, std::string *out, size_t max_depth) {
+        out_ = out;
+        first_ = true;
+        nodes_ = 0;
+        return WalkYaml(root, this, max_depth);
+    }
+
+    bool YamlJsonWriter::IsBareScalar(std::string_view str) {
+        if (str == "true" || str == "false")
+            return true;
+        return !str.empty() && ScanNumber(str.data(), str.data() + str.size()) == str.size();
+    }
+
+    void YamlJsonWriter::WriteString(std::string_view str, std::string *out) {
+        static const char kHex[] = "0123456789abcdef";
+        out->push_back('"');
+        const char *p = str.data();
+        const char *end = p + str.size();
+        while (p < end) {
+            const char *run = p;
+            while (p < end && !kStringStops.stop[static_cast<unsigned char>(*p)])
+                ++p;
+            out->append(run, p - run);
+            if (p == end)
+                break;
+            char c = *p++;
+            switch (c) {
+                case '"': out->append("\\\""); break;
+                case '\\': out->append("\\\\"); break;
+                case '\n': out->append("\\n"); break;
+                case '\r': out->append("\\r"); break;
+                case '\t': out->append("\\t"); break;
+                default:
+                    out->append("\\u00");
+                    out->push_back(kHex[(c >> 4) & 0xf]);
+                    out->push_back(kHex[c & 0xf]);
+                    break;
+            }
+        }
+        out->push_back('"');
+    }
+
+    bool YamlJsonWriter::Prefix(const YamlWalkStep &step) {
+        // null entries are left out of maps, but keep their place in lists
+        if (step.key && step.type() == YamlItem::kNull)
+            return false;
+        ++nodes_;
+        if (!step.depth)
+            return true;
+        if (!first_)
+            out_->push_back(',');
+        first_ = false;
+        if (step.key) {
+            WriteString(*step.key, out_);
+            out_->push_back(':');
+        }
+        return true;
+    }
+
+    void YamlJsonWriter::VisitNull(const YamlWalkStep &step) {
+        if (Prefix(step))
+            out_->append("null");
+    }
+
+    void YamlJsonWriter::VisitScalar(const YamlWalkStep &step, const YamlValue &value) {
+        Prefix(step);
+        if (IsBareScalar(value.str()))
+            out_->append(value.str());
+        else
+            WriteString(value.str(), out_);
+    }
+
+    bool YamlJsonWriter::BeginList(const YamlWalkStep &step, const YamlList &list) {
+        Prefix(step);
+        out_->push_back('[');
+        first_ = true;
+        if (auto packed = list.packed_array()) {
+            // packed numbers are valid JSON numbers as they are
+            for (size_t i = 0, size = packed->size(); i < size; ++i) {
+                if (i)
+                    out_->push_back(',');
+                out_->append(packed->Format(i));
+            }
+            nodes_ += packed->size();
+            first_ = !packed->size();
+        }
+        return true;
+    }
+
+    void YamlJsonWriter::EndList(const YamlWalkStep &, const YamlList &) {
+        out_->push_back(']');
+        first_ = false;
+    }
+
+    bool YamlJsonWriter::BeginMap(const YamlWalkStep &step, const YamlMap &) {
+        Prefix(step);
+        out_->push_back('{');
+        first_ = true;
+        return true;
+    }
+
+    void YamlJsonWriter::EndMap(const YamlWalkStep &, const YamlMap &) {
+        out_->push_back('}');
+        first_ = false;
+    }
+
+}  // namespace yaml
@@ -0,0 +1,102 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <yaml_loader.h>
+
+namespace yaml {
+
+// YamlLoadTask members
+
+    YamlLoadTask::YamlLoadTask() : future_(promise_.get_future().share()) {
+    }
+
+    bool YamlLoadTask::Cancel() {
+        canceled_.store(true, std::memory_order_release);
+        State pending = kPending;
+        if (state_.compare_exchange_strong(pending, kCanceled)) {
+            promise_.set_value(false);
+            return true;
+        }
+        return state() == kRunning;
+    }
+
+    bool YamlLoadTask::Start() {
+        State pending = kPending;
+        return state_.compare_exchange_strong(pending, kRunning);
+    }
+
+    void YamlLoadTask::Finish(bool success) {
+        state_.store(kDone, std::memory_order_release);
+        promise_.set_value(success);
+    }
+
+// YamlLoader members
+
+    YamlLoader &YamlLoader::instance() {
+        static YamlLoader loader;
+        return loader;
+    }
+
+    YamlLoader::YamlLoader() {
+        // loads are mostly parsing, a couple of threads keep up with start-up
+        unsigned count = std::max(1u, std::min(2u, std::thread::hardware_concurrency()));
+        for (unsigned i = 0; i < count; ++i) {
+            threads_.emplace_back(&YamlLoader::Work, this);
+        }
+    }
+
+    YamlLoader::~YamlLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto &thread : threads_) {
+            thread.join();
+        }
+        // jobs never started are canceled, releasing their waiters
+        while (!queue_.empty()) {
+            queue_.top().task->Cancel();
+            queue_.pop();
+        }
+    }
+
+    an<YamlLoadTask> YamlLoader::Schedule(std::function<bool(const YamlLoadTask &task)> job,
+                                          Priority priority,
+                                          YamlLoadCallback callback) {
+        auto task = New<YamlLoadTask>();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push(Job{priority, next_seq_++, task, std::move(job), std::move(callback)});
+        }
+        wake_.notify_one();
+        return task;
+    }
+
+    void YamlLoader::Work() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (stopping_)
+                    return;
+                job = queue_.top();
+                queue_.pop();
+            }
+            // canceled while queued
+            if (!job.task->Start()) {
+                if (job.callback)
+                    job.callback(false);
+                continue;
+            }
+            bool success = job.run(*job.task);
+            job.task->Finish(success);
+            if (job.callback)
+                job.callback(success);
+        }
+    }
+
+}  // namespace yaml
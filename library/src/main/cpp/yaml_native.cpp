@@ -16,12 +16,105 @@ jstring list(JNIEnv *env, jobject thiz, jstring value) {
     return env->NewStringUTF(ostringstream.str().c_str());
 }
 
+void setStatsEnabled(JNIEnv *env, jobject thiz, jboolean enabled) {
+    yaml::Yaml::EnableStats(enabled == JNI_TRUE);
+}
+
+static jlongArray newStatsArray(JNIEnv *env, const yaml::YamlStatsCounter &counter) {
+    jlong values[yaml::YamlStatsCounter::kNumCounters];
+    for (int i = 0; i < yaml::YamlStatsCounter::kNumCounters; ++i) {
+        values[i] = static_cast<jlong>(
+                counter.Get(static_cast<yaml::YamlStatsCounter::Counter>(i)));
+    }
+    jlongArray result = env->NewLongArray(NELEM(values));
+    if (result) {
+        env->SetLongArrayRegion(result, 0, NELEM(values), values);
+    }
+    return result;
+}
+
+jlongArray getGlobalStats(JNIEnv *env, jobject thiz) {
+    return newStatsArray(env, yaml::YamlStatsCounter::global());
+}
+
+void resetGlobalStats(JNIEnv *env, jobject thiz) {
+    yaml::Yaml::ResetGlobalStats();
+}
+
+jlong openLimitedDocument(JNIEnv *env, jobject thiz, jstring fileName, jlong maxNodes) {
+    const char *chars = env->GetStringUTFChars(fileName, nullptr);
+    if (!chars) {
+        return 0;
+    }
+    std::string file_name(chars);
+    env->ReleaseStringUTFChars(fileName, chars);
+    yaml::Yaml *yaml = new yaml::Yaml;
+    yaml::YamlLoadLimits limits;
+    limits.max_nodes = maxNodes > 0 ? static_cast<size_t>(maxNodes) : 0;
+    yaml->SetLoadLimits(limits);
+    if (!yaml->LoadFromFile(file_name)) {
+        delete yaml;
+        return 0;
+    }
+    return reinterpret_cast<jlong>(yaml);
+}
+
+jlong openDocument(JNIEnv *env, jobject thiz, jstring fileName) {
+    return openLimitedDocument(env, thiz, fileName, 0);
+}
+
+jlongArray getDocumentStats(JNIEnv *env, jobject thiz, jlong document) {
+    if (!document) {
+        return nullptr;
+    }
+    return newStatsArray(env, reinterpret_cast<yaml::Yaml *>(document)->stats());
+}
+
+void closeDocument(JNIEnv *env, jobject thiz, jlong document) {
+    delete reinterpret_cast<yaml::Yaml *>(document);
+}
+
 static const JNINativeMethod sMethods[] = {
         {
                 const_cast<char *>("list"),
                 const_cast<char *>("(Ljava/lang/String;)Ljava/lang/String;"),
                 reinterpret_cast<void *>(list)
         },
+        {
+                const_cast<char *>("setStatsEnabled"),
+                const_cast<char *>("(Z)V"),
+                reinterpret_cast<void *>(setStatsEnabled)
+        },
+        {
+                const_cast<char *>("getGlobalStats"),
+                const_cast<char *>("()[J"),
+                reinterpret_cast<void *>(getGlobalStats)
+        },
+        {
+                const_cast<char *>("resetGlobalStats"),
+                const_cast<char *>("()V"),
+                reinterpret_cast<void *>(resetGlobalStats)
+        },
+        {
+                const_cast<char *>("openDocument"),
+                const_cast<char *>("(Ljava/lang/String;)J"),
+                reinterpret_cast<void *>(openDocument)
+        },
+        {
+                const_cast<char *>("openDocument"),
+                const_cast<char *>("(Ljava/lang/String;J)J"),
+                reinterpret_cast<void *>(openLimitedDocument)
+        },
+        {
+                const_cast<char *>("getDocumentStats"),
+                const_cast<char *>("(J)[J"),
+                reinterpret_cast<void *>(getDocumentStats)
+        },
+        {
+                const_cast<char *>("closeDocument"),
+                const_cast<char *>("(J)V"),
+                reinterpret_cast<void *>(closeDocument)
+        },
 
 };
 
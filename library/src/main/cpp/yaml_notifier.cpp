@@ -0,0 +1,103 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <yaml_notifier.h>
+
+namespace yaml {
+
+    // whether path lies at or below prefix, on segment boundaries
+    static bool IsUnder(std::string_view path, std::string_view prefix) {
+        if (prefix.empty())
+            return true;
+        if (path.size() < prefix.size() || path.compare(0, prefix.size(), prefix) != 0)
+            return false;
+        return path.size() == prefix.size() || path[prefix.size()] == '/';
+    }
+
+    int YamlNotifier::Subscribe(const std::string &prefix,
+                                YamlChangeHandler handler,
+                                YamlExecutor executor) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int id = ++next_id_;
+        subscriptions_.push_back(Subscription{id, prefix, handler, executor});
+        count_.store(subscriptions_.size(), std::memory_order_relaxed);
+        return id;
+    }
+
+    void YamlNotifier::Unsubscribe(int id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        subscriptions_.erase(
+                std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                               [id](const Subscription &s) { return s.id == id; }),
+                subscriptions_.end());
+        count_.store(subscriptions_.size(), std::memory_order_relaxed);
+    }
+
+    void YamlNotifier::Notify(std::string_view path) {
+        if (!has_subscribers())
+            return;
+        Notify(std::vector<std::string>(1, std::string(path)));
+    }
+
+    void YamlNotifier::Notify(const std::vector<std::string> &paths) {
+        if (!has_subscribers() || paths.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (batch_depth_ > 0) {
+                pending_.insert(pending_.end(), paths.begin(), paths.end());
+                return;
+            }
+        }
+        Deliver(paths);
+    }
+
+    void YamlNotifier::BeginBatch() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++batch_depth_;
+    }
+
+    void YamlNotifier::EndBatch() {
+        std::vector<std::string> paths;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (batch_depth_ == 0 || --batch_depth_ > 0)
+                return;
+            paths.swap(pending_);
+        }
+        std::sort(paths.begin(), paths.end());
+        paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+        Deliver(paths);
+    }
+
+    void YamlNotifier::Deliver(const std::vector<std::string> &paths) {
+        if (paths.empty())
+            return;
+        std::vector<Subscription> subscriptions;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            subscriptions = subscriptions_;
+        }
+        // handlers run outside the lock, so they may subscribe or write
+        for (const auto &subscription : subscriptions) {
+            std::vector<std::string> matched;
+            for (const auto &path : paths) {
+                if (IsUnder(path, subscription.prefix) ||
+                    IsUnder(subscription.prefix, path)) {
+                    matched.push_back(path);
+                }
+            }
+            if (matched.empty())
+                continue;
+            YamlChangeHandler handler = subscription.handler;
+            if (subscription.executor) {
+                subscription.executor([handler, matched]() { handler(matched); });
+            } else {
+                handler(matched);
+            }
+        }
+    }
+
+}  // namespace yaml
@@ -0,0 +1,87 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <yaml_profile.h>
+
+namespace yaml {
+
+    YamlAccessProfile::YamlAccessProfile(const std::string &file_name,
+                                         std::chrono::milliseconds window)
+            : file_name_(file_name), path_(file_name + ".profile"), window_(window) {
+    }
+
+    bool YamlAccessProfile::Load(std::vector<std::string> *paths) const {
+        std::ifstream in(path_.c_str());
+        if (!in.good())
+            return false;
+        std::string line;
+        while (std::getline(in, line) && paths->size() < kMaxPaths) {
+            if (!line.empty())
+                paths->push_back(line);
+        }
+        return !paths->empty();
+    }
+
+    void YamlAccessProfile::Start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        paths_.clear();
+        seen_.clear();
+        deadline_ = std::chrono::steady_clock::now() + window_;
+        recording_.store(true, std::memory_order_relaxed);
+    }
+
+    void YamlAccessProfile::Record(std::string_view path) {
+        if (!recording_.load(std::memory_order_relaxed))
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!recording_.load(std::memory_order_relaxed))
+            return;
+        if (window_.count() && std::chrono::steady_clock::now() > deadline_) {
+            recording_.store(false, std::memory_order_relaxed);
+            Save();
+            return;
+        }
+        if (path.empty() || path.find('\n') != std::string_view::npos ||
+            paths_.size() >= kMaxPaths)
+            return;
+        if (seen_.emplace(path).second)
+            paths_.emplace_back(path);
+    }
+
+    bool YamlAccessProfile::Stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!recording_.load(std::memory_order_relaxed))
+            return false;
+        recording_.store(false, std::memory_order_relaxed);
+        return Save();
+    }
+
+    bool YamlAccessProfile::Save() {
+        // a run that read nothing keeps the previous profile
+        if (paths_.empty())
+            return false;
+        std::string temp = path_ + ".tmp";
+        {
+            std::ofstream out(temp.c_str());
+            for (const auto &path : paths_) {
+                out << path << '\n';
+            }
+            if (!out.flush()) {
+                ALOGE("failed to write access profile '%s'.", path_.c_str());
+                return false;
+            }
+        }
+        boost::system::error_code ec;
+        boost::filesystem::rename(temp, path_, ec);
+        if (ec) {
+            ALOGE("failed to write access profile '%s'.", path_.c_str());
+            return false;
+        }
+        ALOGI("saved %zu paths to access profile '%s'.", paths_.size(), path_.c_str());
+        return true;
+    }
+
+}  // namespace yaml
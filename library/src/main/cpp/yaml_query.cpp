@@ -0,0 +1,254 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <yaml_data.h>
+#include <yaml_query.h>
+
+namespace yaml {
+
+    // "@N" or "@last"; an empty string leaves *index unchanged
+    static bool ParseIndex(std::string_view str, size_t last, size_t *index) {
+        if (str.empty())
+            return true;
+        if (str[0] != '@' || str.size() < 2)
+            return false;
+        str.remove_prefix(1);
+        if (str == "last") {
+            *index = last;
+            return true;
+        }
+        size_t number = 0;
+        for (char c : str) {
+            if (c < '0' || c > '9')
+                return false;
+            number = number * 10 + (c - '0');
+        }
+        *index = number;
+        return true;
+    }
+
+    bool YamlQuery::Parse(std::string_view pattern) {
+        segments_.clear();
+        if (pattern.empty() || pattern == "/")
+            return true;
+        size_t start = 0;
+        while (true) {
+            size_t end = pattern.find('/', start);
+            std::string_view str = pattern.substr(start, end - start);
+            if (str.empty())
+                return false;
+            Segment segment{Segment::kKey, std::string(), 0, 0};
+            if (str == "**") {
+                segment.kind = Segment::kDescendants;
+            } else if (str == "*") {
+                segment.kind = Segment::kAny;
+            } else if (str[0] == '@' || str.substr(0, 2) == "..") {
+                segment.kind = Segment::kRange;
+                size_t dots = str.find("..");
+                if (dots == std::string_view::npos) {
+                    if (!ParseIndex(str, kLast, &segment.first))
+                        return false;
+                    segment.last = segment.first;
+                } else {
+                    segment.last = kLast;
+                    if (!ParseIndex(str.substr(0, dots), kLast, &segment.first) ||
+                        !ParseIndex(str.substr(dots + 2), kLast, &segment.last))
+                        return false;
+                }
+            } else {
+                segment.key = std::string(str);
+            }
+            // consecutive '**' match the same as one
+            if (segment.kind != Segment::kDescendants || segments_.empty() ||
+                segments_.back().kind != Segment::kDescendants)
+                segments_.push_back(segment);
+            if (end == std::string_view::npos)
+                break;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    void YamlQuery::Run(const YamlItem *root, std::vector<YamlMatch> *matches) const {
+        States states(1, 0);
+        Close(&states);
+        std::string path;
+        std::vector<Frame> stack;
+        Enter(root, std::move(states), &path, &stack, matches);
+        States next;
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            const YamlItem *child = nullptr;
+            const std::string *key = nullptr;
+            size_t index = 0;
+            if (!Next(&frame, &child, &key, &index)) {
+                stack.pop_back();
+                continue;
+            }
+            Step(frame.states, key, index, frame.size, &next);
+            if (next.empty())
+                continue;
+            path.resize(frame.path_length);
+            if (!path.empty())
+                path.push_back('/');
+            if (key)
+                path.append(*key);
+            else
+                path.append("@").append(std::to_string(index));
+            Enter(child, std::move(next), &path, &stack, matches);
+        }
+    }
+
+    void YamlQuery::Enter(const YamlItem *item, States &&states, const std::string *path,
+                          std::vector<Frame> *stack, std::vector<YamlMatch> *matches) const {
+        if (!item)
+            return;
+        if (states.back() == segments_.size())
+            matches->push_back(YamlMatch{*path, item});
+        Frame frame;
+        frame.path_length = path->size();
+        if (auto list = Cast<YamlList>(item)) {
+            frame.list = list;
+            frame.size = list->size();
+            // without wildcards, only the listed ranges are visited
+            frame.next = 0;
+            frame.last = frame.size;
+            if (IsDirect(states)) {
+                size_t size = frame.size;
+                frame.next = size;
+                frame.last = 0;
+                for (size_t state : states) {
+                    if (state == segments_.size() || segments_[state].kind != Segment::kRange)
+                        continue;
+                    const Segment &segment = segments_[state];
+                    frame.next = std::min(frame.next,
+                                          segment.first == kLast ? size - 1 : segment.first);
+                    frame.last = std::max(frame.last,
+                                          segment.last == kLast ? size : segment.last + 1);
+                }
+                frame.last = std::min(frame.last, size);
+            }
+            if (frame.next >= frame.last)
+                return;
+        } else if (auto map = Cast<YamlMap>(item)) {
+            frame.map = map;
+            if (IsDirect(states)) {
+                // keys are looked up rather than scanned, in map order
+                for (size_t state : states) {
+                    if (state < segments_.size() && segments_[state].kind == Segment::kKey)
+                        frame.keys.push_back(&segments_[state].key);
+                }
+                if (frame.keys.empty())
+                    return;
+                std::sort(frame.keys.begin(), frame.keys.end(),
+                          [](const std::string *a, const std::string *b) { return *a < *b; });
+                frame.keys.erase(std::unique(frame.keys.begin(), frame.keys.end(),
+                                             [](const std::string *a, const std::string *b) {
+                                                 return *a == *b;
+                                             }), frame.keys.end());
+                frame.direct = true;
+            } else {
+                frame.entry = map->begin();
+            }
+        } else {
+            return;
+        }
+        frame.states = std::move(states);
+        stack->push_back(std::move(frame));
+    }
+
+    bool YamlQuery::Next(Frame *frame, const YamlItem **child, const std::string **key,
+                         size_t *index) const {
+        if (frame->list) {
+            if (frame->next >= frame->last)
+                return false;
+            *index = frame->next++;
+            *child = frame->list->FindAt(*index)->get();
+            return true;
+        }
+        if (frame->direct) {
+            while (frame->next < frame->keys.size()) {
+                const std::string *name = frame->keys[frame->next++];
+                if (auto slot = frame->map->Find(*name)) {
+                    *key = name;
+                    *child = slot->get();
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (frame->entry == frame->map->end())
+            return false;
+        *key = &frame->entry->first;
+        *child = frame->entry->second.get();
+        ++frame->entry;
+        return true;
+    }
+
+    void YamlQuery::Close(States *states) const {
+        for (size_t i = 0; i < states->size(); ++i) {
+            size_t state = (*states)[i];
+            if (state < segments_.size() && segments_[state].kind == Segment::kDescendants)
+                states->push_back(state + 1);
+        }
+        std::sort(states->begin(), states->end());
+        states->erase(std::unique(states->begin(), states->end()), states->end());
+    }
+
+    bool YamlQuery::IsDirect(const States &states) const {
+        for (size_t state : states) {
+            if (state < segments_.size() && (segments_[state].kind == Segment::kAny ||
+                                             segments_[state].kind == Segment::kDescendants))
+                return false;
+        }
+        return true;
+    }
+
+    void YamlQuery::Step(const States &states, const std::string *key, size_t index,
+                         size_t list_size, States *next) const {
+        next->clear();
+        for (size_t state : states) {
+            if (state == segments_.size())
+                continue;
+            const Segment &segment = segments_[state];
+            switch (segment.kind) {
+                case Segment::kKey:
+                    if (key && *key == segment.key)
+                        next->push_back(state + 1);
+                    break;
+                case Segment::kRange: {
+                    if (key || list_size == 0)
+                        break;
+                    size_t first = segment.first == kLast ? list_size - 1 : segment.first;
+                    size_t last = segment.last == kLast ? list_size - 1 : segment.last;
+                    if (index >= first && index <= last)
+                        next->push_back(state + 1);
+                    break;
+                }
+                case Segment::kAny:
+                    next->push_back(state + 1);
+                    break;
+                case Segment::kDescendants:
+                    next->push_back(state);
+                    break;
+            }
+        }
+        Close(next);
+    }
+
+    bool Yaml::Query(std::string_view pattern, std::vector<YamlMatch> *matches) const {
+        YamlQuery query;
+        if (!query.Parse(pattern)) {
+            ALOGE("invalid query '%.*s'.", int(pattern.size()), pattern.data());
+            return false;
+        }
+        // the root as readers see it, built from the shared segment if attached
+        an<YamlItem> hold;
+        auto slot = data_->FindSlot("", &hold);
+        query.Run(slot ? slot->get() : nullptr, matches);
+        return true;
+    }
+
+}  // namespace yaml
@@ -0,0 +1,249 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <yaml_sequence.h>
+
+namespace yaml {
+
+    YamlChunks::YamlChunks(std::vector<an<YamlItem>> &&elements) : size_(elements.size()) {
+        for (size_t i = 0; i < elements.size(); i += kChunkSize) {
+            size_t end = std::min(i + kChunkSize, elements.size());
+            chunks_.emplace_back(std::make_move_iterator(elements.begin() + i),
+                                 std::make_move_iterator(elements.begin() + end));
+        }
+        elements.clear();
+        Rebuild();
+    }
+
+    size_t YamlChunks::capacity() const {
+        size_t capacity = 0;
+        for (const auto &chunk : chunks_) {
+            capacity += chunk.capacity();
+        }
+        return capacity;
+    }
+
+    an<YamlItem> &YamlChunks::at(size_t i) {
+        size_t offset = 0;
+        size_t chunk = Locate(i, &offset);
+        return chunks_[chunk][offset];
+    }
+
+    const an<YamlItem> &YamlChunks::at(size_t i) const {
+        size_t offset = 0;
+        size_t chunk = Locate(i, &offset);
+        return chunks_[chunk][offset];
+    }
+
+    void YamlChunks::Insert(size_t i, an<YamlItem> element) {
+        if (i == size_) {
+            Append(std::move(element));
+            return;
+        }
+        size_t offset = 0;
+        size_t k = Locate(i, &offset);
+        Chunk &chunk = chunks_[k];
+        chunk.insert(chunk.begin() + offset, std::move(element));
+        ++size_;
+        Add(k, 1);
+        if (chunk.size() >= 2 * kChunkSize)
+            Split(k);
+    }
+
+    void YamlChunks::Erase(size_t i) {
+        size_t offset = 0;
+        size_t k = Locate(i, &offset);
+        Chunk &chunk = chunks_[k];
+        chunk.erase(chunk.begin() + offset);
+        --size_;
+        Add(k, -1);
+        if (chunk.size() < kChunkSize / 2)
+            Rebalance(k);
+    }
+
+    void YamlChunks::Append(an<YamlItem> element) {
+        if (chunks_.empty() || chunks_.back().size() >= kChunkSize) {
+            Chunk chunk;
+            chunk.reserve(kChunkSize);
+            chunk.push_back(std::move(element));
+            ++size_;
+            Push(std::move(chunk));
+            return;
+        }
+        Chunk &chunk = chunks_.back();
+        if (chunk.empty()) {
+            chunk.reserve(kChunkSize);
+            --gaps_;
+        }
+        chunk.push_back(std::move(element));
+        ++size_;
+        Add(chunks_.size() - 1, 1);
+    }
+
+    void YamlChunks::Resize(size_t size) {
+        if (size < size_) {
+            size_t offset = 0;
+            size_t k = size ? Locate(size - 1, &offset) : 0;
+            chunks_.resize(size ? k + 1 : 0);
+            if (size)
+                chunks_.back().resize(offset + 1);
+        } else {
+            size_t pad = size - size_;
+            while (pad) {
+                if (chunks_.empty() || chunks_.back().size() >= kChunkSize)
+                    chunks_.emplace_back();
+                Chunk &chunk = chunks_.back();
+                size_t n = std::min(pad, kChunkSize - chunk.size());
+                chunk.resize(chunk.size() + n);
+                pad -= n;
+            }
+        }
+        size_ = size;
+        Rebuild();
+    }
+
+    std::vector<an<YamlItem>> YamlChunks::Flatten() {
+        std::vector<an<YamlItem>> elements;
+        elements.reserve(size_);
+        for (auto &chunk : chunks_) {
+            elements.insert(elements.end(), std::make_move_iterator(chunk.begin()),
+                            std::make_move_iterator(chunk.end()));
+        }
+        chunks_.clear();
+        tree_.clear();
+        size_ = 0;
+        gaps_ = 0;
+        return elements;
+    }
+
+    size_t YamlChunks::Locate(size_t i, size_t *offset) const {
+        size_t n = chunks_.size();
+        size_t step = 1;
+        while (step * 2 <= n)
+            step *= 2;
+        // descends to the last chunk whose prefix of sizes is <= i, which
+        // is not empty, as the next prefix is larger
+        size_t k = 0;
+        for (; step; step /= 2) {
+            if (k + step <= n && tree_[k + step] <= i) {
+                k += step;
+                i -= tree_[k];
+            }
+        }
+        *offset = i;
+        return k;
+    }
+
+    size_t YamlChunks::Prefix(size_t chunk) const {
+        size_t sum = 0;
+        for (size_t j = chunk; j; j -= j & (~j + 1)) {
+            sum += tree_[j];
+        }
+        return sum;
+    }
+
+    void YamlChunks::Add(size_t chunk, std::ptrdiff_t delta) {
+        for (size_t j = chunk + 1; j < tree_.size(); j += j & (~j + 1)) {
+            tree_[j] += delta;
+        }
+    }
+
+    void YamlChunks::Push(Chunk &&chunk) {
+        // node j covers the chunks (j - lowbit(j), j]
+        size_t j = chunks_.size() + 1;
+        tree_.push_back(chunk.size() + Prefix(j - 1) - Prefix(j - (j & (~j + 1))));
+        chunks_.push_back(std::move(chunk));
+    }
+
+    void YamlChunks::Split(size_t k) {
+        if (!(k + 1 < chunks_.size() && chunks_[k + 1].empty()) &&
+            !(k > 0 && chunks_[k - 1].empty()))
+            k = Spread(k);
+        size_t half = chunks_[k].size() / 2;
+        if (k + 1 < chunks_.size() && chunks_[k + 1].empty())
+            Move(k, k + 1, half);
+        else
+            Move(k, k - 1, half);
+        --gaps_;
+    }
+
+    void YamlChunks::Rebalance(size_t k) {
+        size_t size = chunks_[k].size();
+        if (!size) {
+            Chunk().swap(chunks_[k]);
+            ++gaps_;
+        } else {
+            // the nearest chunk on either side holding elements
+            size_t before = Prefix(k), offset = 0;
+            size_t j;
+            if (before)
+                j = Locate(before - 1, &offset);
+            else if (before + size < size_)
+                j = Locate(before + size, &offset);
+            else
+                return;
+            if (chunks_[j].size() + size < 2 * kChunkSize) {
+                Move(k, j, size);
+                Chunk().swap(chunks_[k]);
+                ++gaps_;
+            } else {
+                // evens out the two
+                Move(j, k, (chunks_[j].size() - size) / 2);
+                return;
+            }
+        }
+        // spread out, as to leave one empty slot per chunk
+        if (gaps_ > 2 * (chunks_.size() - gaps_) + 2)
+            Spread(0);
+    }
+
+    void YamlChunks::Move(size_t from, size_t to, size_t count) {
+        Chunk &source = chunks_[from];
+        Chunk &target = chunks_[to];
+        if (from < to) {
+            target.insert(target.begin(), std::make_move_iterator(source.end() - count),
+                          std::make_move_iterator(source.end()));
+            source.resize(source.size() - count);
+        } else {
+            target.insert(target.end(), std::make_move_iterator(source.begin()),
+                          std::make_move_iterator(source.begin() + count));
+            source.erase(source.begin(), source.begin() + count);
+        }
+        Add(from, -std::ptrdiff_t(count));
+        Add(to, count);
+    }
+
+    size_t YamlChunks::Spread(size_t k) {
+        std::vector<Chunk> chunks;
+        chunks.reserve(2 * (chunks_.size() - gaps_));
+        size_t moved = 0;
+        for (size_t j = 0; j < chunks_.size(); ++j) {
+            if (chunks_[j].empty())
+                continue;
+            if (j == k)
+                moved = chunks.size();
+            chunks.push_back(std::move(chunks_[j]));
+            chunks.emplace_back();
+        }
+        chunks_.swap(chunks);
+        Rebuild();
+        return moved;
+    }
+
+    void YamlChunks::Rebuild() {
+        size_t n = chunks_.size();
+        tree_.assign(n + 1, 0);
+        gaps_ = 0;
+        for (size_t j = 1; j <= n; ++j) {
+            tree_[j] += chunks_[j - 1].size();
+            if (chunks_[j - 1].empty())
+                ++gaps_;
+            size_t parent = j + (j & (~j + 1));
+            if (parent <= n)
+                tree_[parent] += tree_[j];
+        }
+    }
+
+}  // namespace yaml
@@ -0,0 +1,565 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <yaml_shared.h>
+
+namespace yaml {
+
+    namespace {
+
+        const uint32_t kMagic = 0x4c4d4159;  // "YAML"
+        const uint32_t kVersion = 1;
+        // slots start on their own pages
+        const size_t kPageSize = 4096;
+        // a reader gives up on a publisher rewriting the slot this often
+        const int kMaxAttempts = 1000;
+
+        // nodes are written after their children, so a valid image only ever
+        // refers back to lower offsets; offset 0 holds the root and stands
+        // for an empty slot elsewhere
+        struct Node {
+            uint32_t type;
+            // scalar length, or number of elements or entries
+            uint32_t size;
+            // offset of the text, or of the element or entry array
+            uint32_t data;
+            uint32_t reserved;
+        };
+
+        struct Entry {
+            uint32_t key;
+            uint32_t key_size;
+            uint32_t node;
+            uint32_t reserved;
+        };
+
+        class ImageWriter {
+        public:
+            explicit ImageWriter(std::string *image) : image_(image) {
+                image_->assign(8, '\0');
+            }
+
+            void WriteRoot(const YamlItem *root) {
+                uint32_t offset = Write(root);
+                memcpy(&(*image_)[0], &offset, sizeof(offset));
+            }
+
+        private:
+            uint32_t Reserve(size_t bytes) {
+                size_t offset = (image_->size() + 7) & ~size_t(7);
+                image_->resize(offset + bytes);
+                return uint32_t(offset);
+            }
+
+            uint32_t Put(const void *data, size_t bytes) {
+                uint32_t offset = Reserve(bytes);
+                if (bytes)
+                    memcpy(&(*image_)[offset], data, bytes);
+                return offset;
+            }
+
+            uint32_t PutNode(YamlItem::ValueType type, size_t size, uint32_t data) {
+                Node node{uint32_t(type), uint32_t(size), data, 0};
+                return Put(&node, sizeof(node));
+            }
+
+            // nodes are written after their children, whose offsets wait on
+            // a stack of their own until their parent takes them. a node held
+            // more than once, aliased or deduped, is written once and its
+            // offset taken by every parent
+            uint32_t Write(const YamlItem *root) {
+                struct Pending {
+                    const YamlItem *item;
+                    bool expanded;
+                    bool shared;
+                };
+                std::vector<Pending> stack(1, Pending{root, false, false});
+                std::vector<uint32_t> written;
+                std::unordered_map<const YamlItem *, uint32_t> shared;
+                while (!stack.empty()) {
+                    Pending top = stack.back();
+                    if (!top.expanded) {
+                        if (top.shared) {
+                            auto it = shared.find(top.item);
+                            if (it != shared.end()) {
+                                stack.pop_back();
+                                written.push_back(it->second);
+                                continue;
+                            }
+                        }
+                        stack.back().expanded = true;
+                        size_t first = stack.size();
+                        auto list = Cast<YamlList>(top.item);
+                        if (list && !list->packed()) {
+                            for (auto it = list->begin(), end = list->end(); it != end; ++it)
+                                stack.push_back(Pending{it->get(), false, it->use_count() > 1});
+                        } else if (auto map = Cast<YamlMap>(top.item)) {
+                            for (auto it = map->begin(), end = map->end(); it != end; ++it)
+                                stack.push_back(Pending{it->second.get(), false,
+                                                        it->second.use_count() > 1});
+                        }
+                        // written in document order
+                        std::reverse(stack.begin() + first, stack.end());
+                        if (stack.size() > first)
+                            continue;
+                    }
+                    stack.pop_back();
+                    uint32_t offset = WriteNode(top.item, &written);
+                    if (top.shared && offset)
+                        shared.emplace(top.item, offset);
+                    written.push_back(offset);
+                }
+                return written.back();
+            }
+
+            // item, whose children are the last offsets written
+            uint32_t WriteNode(const YamlItem *item, std::vector<uint32_t> *written) {
+                if (!item || item->type() == YamlItem::kNull)
+                    return 0;
+                if (auto value = Cast<YamlValue>(item)) {
+                    const std::string &str = value->str();
+                    return PutNode(YamlItem::kScalar, str.size(), Put(str.data(), str.size()));
+                }
+                if (auto list = Cast<YamlList>(item)) {
+                    std::vector<uint32_t> elements;
+                    if (auto packed = list->packed_array()) {
+                        // formatted one by one rather than materialized
+                        elements.reserve(packed->size());
+                        for (size_t i = 0, size = packed->size(); i < size; ++i) {
+                            std::string text = packed->Format(i);
+                            elements.push_back(PutNode(YamlItem::kScalar, text.size(),
+                                                       Put(text.data(), text.size())));
+                        }
+                    } else {
+                        elements.assign(written->end() - list->size(), written->end());
+                        written->resize(written->size() - list->size());
+                    }
+                    uint32_t data = Put(elements.data(), elements.size() * sizeof(uint32_t));
+                    return PutNode(YamlItem::kList, elements.size(), data);
+                }
+                auto map = Cast<YamlMap>(item);
+                std::vector<Entry> entries;
+                entries.reserve(map->size());
+                auto node = written->end() - map->size();
+                // std::map order is the byte order readers search by
+                for (auto it = map->begin(), end = map->end(); it != end; ++it, ++node) {
+                    uint32_t key = Put(it->first.data(), it->first.size());
+                    entries.push_back(Entry{key, uint32_t(it->first.size()), *node, 0});
+                }
+                written->resize(written->size() - map->size());
+                uint32_t data = Put(entries.data(), entries.size() * sizeof(Entry));
+                return PutNode(YamlItem::kMap, entries.size(), data);
+            }
+
+            std::string *image_;
+        };
+
+        // reads an image that may be torn by a concurrent publish; every
+        // offset is checked, and ok() turns false on the first bad one
+        class ImageReader {
+        public:
+            ImageReader(const char *base, size_t size) : base_(base), size_(size) {}
+
+            bool ok() const { return ok_; }
+
+            bool Root(Node *node) {
+                uint32_t offset = 0;
+                if (!Read(0, &offset, sizeof(offset)))
+                    return false;
+                return GetNode(offset, UINT32_MAX, node);
+            }
+
+            // false if there is no node at path, or the image is bad
+            bool Resolve(std::string_view path, Node *node) {
+                if (!Root(node))
+                    return false;
+                size_t start = 0;
+                while (start < path.size()) {
+                    size_t end = std::min(path.find('/', start), path.size());
+                    std::string_view segment = path.substr(start, end - start);
+                    if (!Step(node, segment))
+                        return false;
+                    start = end + 1;
+                }
+                return true;
+            }
+
+            // deep copies the subtree at offset. lists and maps being
+            // filled wait on a stack, so a deep image is safe to read. a node
+            // written once for several parents is built once, too
+            an<YamlItem> Build(const Node &node, uint32_t offset) {
+                std::vector<Pending> stack;
+                std::unordered_map<uint32_t, an<YamlItem>> built;
+                an<YamlItem> root = Create(node, offset, &stack);
+                while (ok_ && !stack.empty()) {
+                    Pending &top = stack.back();
+                    if (top.next == top.node.size) {
+                        stack.pop_back();
+                        continue;
+                    }
+                    uint32_t i = top.next++;
+                    YamlItem *container = top.container.get();
+                    uint32_t parent = top.offset;
+                    uint32_t element = 0;
+                    std::string key;
+                    if (top.node.type == YamlItem::kList) {
+                        if (!Read(top.node.data + size_t(i) * sizeof(uint32_t), &element,
+                                  sizeof(element)))
+                            return nullptr;
+                    } else {
+                        Entry entry;
+                        if (!ReadEntry(top.node, i, &entry) || !Key(entry, &key))
+                            return nullptr;
+                        element = entry.node;
+                    }
+                    Node child;
+                    an<YamlItem> item;
+                    // checked against this parent even if built already
+                    if (GetNode(element, parent, &child)) {
+                        auto it = built.find(element);
+                        if (it != built.end()) {
+                            item = it->second;
+                        } else {
+                            // may stack the child, invalidating top
+                            item = Create(child, element, &stack);
+                            built.emplace(element, item);
+                        }
+                    }
+                    if (!ok_)
+                        return nullptr;
+                    if (container->type() == YamlItem::kList)
+                        static_cast<YamlList *>(container)->Append(std::move(item));
+                    else
+                        static_cast<YamlMap *>(container)->Set(std::move(key), std::move(item));
+                }
+                return ok_ ? root : nullptr;
+            }
+
+            // offset of the node last reached by Resolve()
+            uint32_t offset() const { return offset_; }
+
+        private:
+            // a list or map whose children are being built
+            struct Pending {
+                Node node;
+                uint32_t offset;
+                an<YamlItem> container;
+                uint32_t next;
+            };
+
+            // a scalar, or an empty list or map stacked to be filled
+            an<YamlItem> Create(const Node &node, uint32_t offset, std::vector<Pending> *stack) {
+                switch (node.type) {
+                    case YamlItem::kScalar: {
+                        std::string text(node.size, '\0');
+                        if (!Read(node.data, &text[0], node.size))
+                            return nullptr;
+                        return New<YamlValue>(std::move(text));
+                    }
+                    case YamlItem::kList:
+                    case YamlItem::kMap: {
+                        an<YamlItem> container;
+                        if (node.type == YamlItem::kList)
+                            container = New<YamlList>();
+                        else
+                            container = New<YamlMap>();
+                        stack->push_back(Pending{node, offset, container, 0});
+                        return container;
+                    }
+                    default:
+                        return Fail();
+                }
+            }
+
+            bool Step(Node *node, std::string_view segment) {
+                uint32_t parent = offset_;
+                if (node->type == YamlItem::kList && !segment.empty() && segment[0] == '@') {
+                    size_t index = 0;
+                    if (segment == "@last") {
+                        if (!node->size)
+                            return false;
+                        index = node->size - 1;
+                    } else {
+                        if (segment.size() < 2)
+                            return false;
+                        for (char c : segment.substr(1)) {
+                            if (c < '0' || c > '9')
+                                return false;
+                            index = index * 10 + (c - '0');
+                        }
+                    }
+                    uint32_t element = 0;
+                    if (index >= node->size ||
+                        !Read(node->data + index * sizeof(uint32_t), &element, sizeof(element)))
+                        return false;
+                    return GetNode(element, parent, node);
+                }
+                if (node->type != YamlItem::kMap)
+                    return false;
+                // binary search of the sorted entries
+                size_t low = 0, high = node->size;
+                while (low < high) {
+                    size_t middle = (low + high) / 2;
+                    Entry entry;
+                    std::string key;
+                    if (!ReadEntry(*node, middle, &entry) || !Key(entry, &key))
+                        return false;
+                    int order = std::string_view(key).compare(segment);
+                    if (order == 0)
+                        return GetNode(entry.node, parent, node);
+                    if (order < 0)
+                        low = middle + 1;
+                    else
+                        high = middle;
+                }
+                return false;
+            }
+
+            // a node at offset, which must lie below its parent's
+            bool GetNode(uint32_t offset, uint32_t parent, Node *node) {
+                if (!offset)
+                    return false;
+                if (offset >= parent || offset % 8 || !Read(offset, node, sizeof(Node)))
+                    return Fail(), false;
+                offset_ = offset;
+                return true;
+            }
+
+            bool ReadEntry(const Node &map, size_t i, Entry *entry) {
+                return Read(map.data + i * sizeof(Entry), entry, sizeof(Entry));
+            }
+
+            bool Key(const Entry &entry, std::string *key) {
+                key->resize(entry.key_size);
+                return Read(entry.key, &(*key)[0], entry.key_size);
+            }
+
+            bool Read(size_t offset, void *out, size_t bytes) {
+                if (!ok_ || offset > size_ || bytes > size_ - offset)
+                    return Fail(), false;
+                if (bytes)
+                    memcpy(out, base_ + offset, bytes);
+                return true;
+            }
+
+            std::nullptr_t Fail() {
+                ok_ = false;
+                return nullptr;
+            }
+
+            const char *base_;
+            size_t size_;
+            uint32_t offset_ = UINT32_MAX;
+            bool ok_ = true;
+        };
+
+        int CreateMemfd(const char *name) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+            // MFD_CLOEXEC, spelled out for headers older than memfd_create()
+            return int(syscall(SYS_memfd_create, name, 1u));
+#else
+            errno = ENOSYS;
+            return -1;
+#endif
+        }
+
+    }  // namespace
+
+    struct YamlSharedSegment::Header {
+        uint32_t magic;
+        uint32_t version;
+        // the slot of the current generation is generation % 2
+        std::atomic<uint64_t> generation;
+        // odd while the slot is being written
+        std::atomic<uint64_t> sequence[2];
+        std::atomic<uint64_t> offset[2];
+        std::atomic<uint64_t> size[2];
+        std::atomic<uint64_t> capacity[2];
+        std::atomic<uint64_t> file_size;
+    };
+
+    YamlSharedSegment::YamlSharedSegment(int fd, bool writable)
+            : fd_(fd), writable_(writable) {
+    }
+
+    YamlSharedSegment::~YamlSharedSegment() {
+        if (base_)
+            munmap(base_, mapped_);
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    an<YamlSharedSegment> YamlSharedSegment::Create(const std::string &name) {
+        static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                      "atomics in shared memory need to be lock-free");
+        static_assert(sizeof(Header) <= kPageSize, "header fits in a page");
+        int fd = CreateMemfd(name.c_str());
+        if (fd < 0) {
+            ALOGE("failed to create shared memory '%s': %s", name.c_str(), strerror(errno));
+            return nullptr;
+        }
+        an<YamlSharedSegment> segment(new YamlSharedSegment(fd, true));
+        if (ftruncate(fd, kPageSize) != 0 || !segment->Map(kPageSize)) {
+            ALOGE("failed to size shared memory '%s'.", name.c_str());
+            return nullptr;
+        }
+        Header *header = new(segment->base_) Header();
+        header->magic = kMagic;
+        header->version = kVersion;
+        header->file_size.store(kPageSize, std::memory_order_release);
+        return segment;
+    }
+
+    an<YamlSharedSegment> YamlSharedSegment::Attach(int fd) {
+        int own_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (own_fd < 0) {
+            ALOGE("failed to attach shared memory: %s", strerror(errno));
+            return nullptr;
+        }
+        an<YamlSharedSegment> segment(new YamlSharedSegment(own_fd, false));
+        struct stat st;
+        if (fstat(own_fd, &st) != 0 || size_t(st.st_size) < kPageSize ||
+            !segment->Map(size_t(st.st_size))) {
+            ALOGE("failed to map shared memory.");
+            return nullptr;
+        }
+        Header *header = segment->header();
+        if (header->magic != kMagic || header->version != kVersion) {
+            ALOGE("not a shared config segment.");
+            return nullptr;
+        }
+        return segment;
+    }
+
+    bool YamlSharedSegment::Map(size_t size) {
+        int protection = PROT_READ | (writable_ ? PROT_WRITE : 0);
+        void *base = mmap(nullptr, size, protection, MAP_SHARED, fd_, 0);
+        if (base == MAP_FAILED)
+            return false;
+        if (base_)
+            munmap(base_, mapped_);
+        base_ = static_cast<char *>(base);
+        mapped_ = size;
+        return true;
+    }
+
+    YamlSharedSegment::Header *YamlSharedSegment::header() const {
+        return reinterpret_cast<Header *>(base_);
+    }
+
+    uint64_t YamlSharedSegment::generation() const {
+        // the header page stays at the start of every mapping
+        std::shared_lock<std::shared_mutex> lock(map_mutex_);
+        return header()->generation.load(std::memory_order_acquire);
+    }
+
+    void YamlSharedSegment::Encode(const YamlItem *root, std::string *image) {
+        ImageWriter(image).WriteRoot(root);
+    }
+
+    bool YamlSharedSegment::Publish(const YamlItem *root) {
+        if (!writable_) {
+            ALOGE("shared config segment is attached read-only.");
+            return false;
+        }
+        std::string image;
+        Encode(root, &image);
+        if (image.size() > UINT32_MAX) {
+            ALOGE("config too large to share: %zu bytes.", image.size());
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        Header *h = header();
+        uint64_t generation = h->generation.load(std::memory_order_relaxed);
+        int slot = int((generation + 1) % 2);
+        uint64_t offset = h->offset[slot].load(std::memory_order_relaxed);
+        uint64_t capacity = h->capacity[slot].load(std::memory_order_relaxed);
+        if (capacity < image.size()) {
+            // a larger region at the end; the old one is abandoned
+            offset = (h->file_size.load(std::memory_order_relaxed) + kPageSize - 1) &
+                     ~uint64_t(kPageSize - 1);
+            capacity = image.size() + image.size() / 2;
+            size_t file_size = size_t(offset + capacity);
+            std::unique_lock<std::shared_mutex> map_lock(map_mutex_);
+            if (ftruncate(fd_, off_t(file_size)) != 0 || !Map(file_size)) {
+                ALOGE("failed to grow shared memory: %s", strerror(errno));
+                return false;
+            }
+            h = header();
+            h->file_size.store(file_size, std::memory_order_release);
+        }
+        std::shared_lock<std::shared_mutex> map_lock(map_mutex_);
+        // readers of this slot retry until the sequence is even again
+        uint64_t sequence = h->sequence[slot].load(std::memory_order_relaxed);
+        h->sequence[slot].store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(base_ + offset, image.data(), image.size());
+        h->offset[slot].store(offset, std::memory_order_relaxed);
+        h->size[slot].store(image.size(), std::memory_order_relaxed);
+        h->capacity[slot].store(capacity, std::memory_order_relaxed);
+        h->sequence[slot].store(sequence + 2, std::memory_order_release);
+        h->generation.store(generation + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool YamlSharedSegment::Read(std::string_view path, an<YamlItem> *item,
+                                 uint64_t *generation) {
+        for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+            std::shared_lock<std::shared_mutex> lock(map_mutex_);
+            Header *h = header();
+            uint64_t current = h->generation.load(std::memory_order_acquire);
+            *generation = current;
+            if (!current)
+                return false;
+            int slot = int(current % 2);
+            uint64_t sequence = h->sequence[slot].load(std::memory_order_acquire);
+            if (sequence & 1) {
+                lock.unlock();
+                std::this_thread::yield();
+                continue;
+            }
+            uint64_t offset = h->offset[slot].load(std::memory_order_relaxed);
+            uint64_t size = h->size[slot].load(std::memory_order_relaxed);
+            if (offset + size > mapped_) {
+                // grown by the publisher since we mapped it
+                size_t file_size = size_t(h->file_size.load(std::memory_order_acquire));
+                lock.unlock();
+                std::unique_lock<std::shared_mutex> map_lock(map_mutex_);
+                if (file_size > mapped_ && !Map(file_size)) {
+                    ALOGE("failed to remap shared memory: %s", strerror(errno));
+                    return false;
+                }
+                continue;
+            }
+            ImageReader reader(base_ + offset, size_t(size));
+            Node node;
+            bool found = reader.Resolve(path, &node);
+            an<YamlItem> result = found ? reader.Build(node, reader.offset()) : nullptr;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (h->sequence[slot].load(std::memory_order_relaxed) != sequence)
+                continue;
+            if (!reader.ok()) {
+                ALOGE("corrupt shared config, generation %llu.", (unsigned long long) current);
+                return false;
+            }
+            *item = result;
+            return found;
+        }
+        ALOGW("shared config kept changing while being read.");
+        return false;
+    }
+
+}  // namespace yaml
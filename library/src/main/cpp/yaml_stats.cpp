@@ -0,0 +1,43 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <yaml_stats.h>
+
+namespace yaml {
+
+    std::atomic<bool> YamlStatsCounter::enabled_(false);
+
+    YamlStatsCounter::YamlStatsCounter() {
+        Reset();
+    }
+
+    YamlStatsCounter &YamlStatsCounter::global() {
+        static YamlStatsCounter instance;
+        return instance;
+    }
+
+    void YamlStatsCounter::Snapshot(YamlStats *stats) const {
+        if (!stats) return;
+        stats->loads = Get(kLoads);
+        stats->load_failures = Get(kLoadFailures);
+        stats->parse_time_us = Get(kParseTimeUs);
+        stats->bytes_parsed = Get(kBytesParsed);
+        stats->nodes[0] = Get(kNullNodes);
+        stats->nodes[1] = Get(kScalarNodes);
+        stats->nodes[2] = Get(kListNodes);
+        stats->nodes[3] = Get(kMapNodes);
+        stats->traversals = Get(kTraversals);
+        stats->path_cache_hits = Get(kPathCacheHits);
+        stats->failed_lookups = Get(kFailedLookups);
+        stats->set_item_calls = Get(kSetItemCalls);
+        stats->saves = Get(kSaves);
+    }
+
+    void YamlStatsCounter::Reset() {
+        for (auto &counter : counters_) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+
+}  // namespace yaml
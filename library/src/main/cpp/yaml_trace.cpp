@@ -0,0 +1,96 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <fstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <yaml_json.h>
+#include <yaml_trace.h>
+
+namespace yaml {
+
+    std::atomic<bool> YamlTracer::enabled_(false);
+
+    namespace {
+
+        std::mutex sink_mutex;
+        an<YamlTraceSink> current_sink;
+
+        int64_t Microseconds(std::chrono::steady_clock::duration duration) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        }
+
+    }  // namespace
+
+    void YamlTracer::set_sink(an<YamlTraceSink> sink) {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        enabled_.store(bool(sink), std::memory_order_relaxed);
+        current_sink = std::move(sink);
+    }
+
+    an<YamlTraceSink> YamlTracer::sink() {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        return current_sink;
+    }
+
+    void YamlTraceScope::Begin(const char *name, std::string_view file_name) {
+        sink_ = YamlTracer::sink();
+        span_.name = name;
+        span_.file_name = file_name;
+        span_.start = std::chrono::steady_clock::now();
+    }
+
+    void YamlTraceScope::End() {
+        span_.duration = std::chrono::steady_clock::now() - span_.start;
+        sink_->Record(span_);
+    }
+
+    YamlChromeTraceSink::YamlChromeTraceSink(const std::string &file_name)
+            : file_name_(file_name) {
+    }
+
+    YamlChromeTraceSink::~YamlChromeTraceSink() {
+        Flush();
+    }
+
+    void YamlChromeTraceSink::Record(const YamlTraceSpan &span) {
+        static const long pid = getpid();
+        long tid = syscall(SYS_gettid);
+        std::string event;
+        event.reserve(160 + span.file_name.size());
+        event.append("{\"name\":");
+        YamlJsonWriter::WriteString(span.name, &event);
+        event.append(",\"cat\":\"yaml\",\"ph\":\"X\",\"ts\":");
+        event.append(std::to_string(Microseconds(span.start.time_since_epoch())));
+        event.append(",\"dur\":");
+        event.append(std::to_string(Microseconds(span.duration)));
+        event.append(",\"pid\":");
+        event.append(std::to_string(pid));
+        event.append(",\"tid\":");
+        event.append(std::to_string(tid));
+        event.append(",\"args\":{\"file\":");
+        YamlJsonWriter::WriteString(span.file_name, &event);
+        event.append(",\"bytes\":");
+        event.append(std::to_string(span.bytes));
+        event.append(",\"nodes\":");
+        event.append(std::to_string(span.nodes));
+        event.append("}}");
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!events_.empty())
+            events_.append(",\n");
+        events_.append(event);
+    }
+
+    bool YamlChromeTraceSink::Flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream out(file_name_.c_str());
+        out << "{\"traceEvents\":[\n" << events_ << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        if (!out.flush()) {
+            ALOGE("failed to write trace '%s'.", file_name_.c_str());
+            return false;
+        }
+        return true;
+    }
+
+}  // namespace yaml
@@ -0,0 +1,166 @@
+//
+// Copyright RIME Developers
+// Distributed under the BSD License
+//
+#include <yaml_walk.h>
+
+namespace yaml {
+
+    namespace {
+
+        YamlWalkStep RootStep(const an<YamlItem> &root) {
+            YamlWalkStep step;
+            step.item = root.get();
+            step.slot = &root;
+            return step;
+        }
+
+        YamlWalkStep RootStep(const YamlItem *root) {
+            YamlWalkStep step;
+            step.item = root;
+            return step;
+        }
+
+        // calls the visitor for step; true if its children are to be walked
+        bool Visit(const YamlWalkStep &step, YamlVisitor *visitor) {
+            switch (step.type()) {
+                case YamlItem::kScalar:
+                    visitor->VisitScalar(step, *static_cast<const YamlValue *>(step.item));
+                    return false;
+                case YamlItem::kList:
+                    return visitor->BeginList(step, *static_cast<const YamlList *>(step.item));
+                case YamlItem::kMap:
+                    return visitor->BeginMap(step, *static_cast<const YamlMap *>(step.item));
+                default:
+                    visitor->VisitNull(step);
+                    return false;
+            }
+        }
+
+        void Leave(const YamlWalkStep &step, YamlVisitor *visitor) {
+            if (step.type() == YamlItem::kList)
+                visitor->EndList(step, *static_cast<const YamlList *>(step.item));
+            else
+                visitor->EndMap(step, *static_cast<const YamlMap *>(step.item));
+        }
+
+        bool Walk(YamlWalkStep step, YamlVisitor *visitor, size_t max_depth) {
+            std::vector<YamlWalkFrame> stack;
+            while (true) {
+                if (max_depth && step.depth > max_depth)
+                    return false;
+                if (Visit(step, visitor)) {
+                    stack.emplace_back();
+                    if (!stack.back().Open(step)) {
+                        stack.pop_back();
+                        Leave(step, visitor);
+                    }
+                }
+                while (!stack.empty() && !stack.back().Next(&step)) {
+                    Leave(stack.back().parent(), visitor);
+                    stack.pop_back();
+                }
+                if (stack.empty())
+                    return true;
+            }
+        }
+
+    }  // namespace
+
+    bool YamlWalkFrame::Open(const YamlWalkStep &parent) {
+        parent_ = parent;
+        index_ = 0;
+        if (auto list = Cast<YamlList>(parent.item)) {
+            // iterating a packed list would materialize its elements
+            if (list->packed() || !list->size())
+                return false;
+            element_ = list->begin();
+            elements_end_ = list->end();
+            return true;
+        }
+        if (auto map = Cast<YamlMap>(parent.item)) {
+            entry_ = map->begin();
+            entries_end_ = map->end();
+            return entry_ != entries_end_;
+        }
+        return false;
+    }
+
+    bool YamlWalkFrame::Next(YamlWalkStep *step) {
+        if (parent_.type() == YamlItem::kList) {
+            if (element_ == elements_end_)
+                return false;
+            step->slot = &*element_;
+            step->key = nullptr;
+            ++element_;
+        } else {
+            if (entry_ == entries_end_)
+                return false;
+            step->slot = &entry_->second;
+            step->key = &entry_->first;
+            ++entry_;
+        }
+        step->item = step->slot->get();
+        step->index = index_++;
+        step->depth = parent_.depth + 1;
+        return true;
+    }
+
+    YamlDepthFirstIterator::YamlDepthFirstIterator(const an<YamlItem> &root)
+            : step_(RootStep(root)), done_(false) {
+    }
+
+    YamlDepthFirstIterator::YamlDepthFirstIterator(const YamlItem *root)
+            : step_(RootStep(root)), done_(false) {
+    }
+
+    YamlDepthFirstIterator &YamlDepthFirstIterator::operator++() {
+        if (done_)
+            return *this;
+        if (!skip_) {
+            stack_.emplace_back();
+            if (!stack_.back().Open(step_))
+                stack_.pop_back();
+        }
+        skip_ = false;
+        while (!stack_.empty()) {
+            if (stack_.back().Next(&step_))
+                return *this;
+            stack_.pop_back();
+        }
+        done_ = true;
+        step_ = YamlWalkStep();
+        return *this;
+    }
+
+    YamlBreadthFirstIterator::YamlBreadthFirstIterator(const an<YamlItem> &root) {
+        queue_.push_back(RootStep(root));
+    }
+
+    YamlBreadthFirstIterator::YamlBreadthFirstIterator(const YamlItem *root) {
+        queue_.push_back(RootStep(root));
+    }
+
+    YamlBreadthFirstIterator &YamlBreadthFirstIterator::operator++() {
+        if (queue_.empty())
+            return *this;
+        YamlWalkFrame frame;
+        if (!skip_ && frame.Open(queue_.front())) {
+            YamlWalkStep step;
+            while (frame.Next(&step))
+                queue_.push_back(step);
+        }
+        skip_ = false;
+        queue_.pop_front();
+        return *this;
+    }
+
+    bool WalkYaml(const an<YamlItem> &root, YamlVisitor *visitor, size_t max_depth) {
+        return Walk(RootStep(root), visitor, max_depth);
+    }
+
+    bool WalkYaml(const YamlItem *root, YamlVisitor *visitor, size_t max_depth) {
+        return Walk(RootStep(root), visitor, max_depth);
+    }
+
+}  // namespace yaml
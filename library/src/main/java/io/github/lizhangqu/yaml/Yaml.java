@@ -13,5 +13,54 @@ public class Yaml {
         System.loadLibrary("yaml");
     }
 
+    /**
+     * indices into the array returned by {@link #getGlobalStats()},
+     * kept in sync with YamlStatsCounter::Counter
+     */
+    public static final int STAT_LOADS = 0;
+    public static final int STAT_LOAD_FAILURES = 1;
+    public static final int STAT_PARSE_TIME_US = 2;
+    public static final int STAT_BYTES_PARSED = 3;
+    public static final int STAT_NULL_NODES = 4;
+    public static final int STAT_SCALAR_NODES = 5;
+    public static final int STAT_LIST_NODES = 6;
+    public static final int STAT_MAP_NODES = 7;
+    public static final int STAT_TRAVERSALS = 8;
+    public static final int STAT_PATH_CACHE_HITS = 9;
+    public static final int STAT_FAILED_LOOKUPS = 10;
+    public static final int STAT_SET_ITEM_CALLS = 11;
+    public static final int STAT_SAVES = 12;
+
     public static final native String list(String value);
+
+    /**
+     * turn process-wide runtime counters on or off, off by default
+     */
+    public static final native void setStatsEnabled(boolean enabled);
+
+    /**
+     * snapshot of process-wide runtime counters, indexed by the STAT_* constants
+     */
+    public static final native long[] getGlobalStats();
+
+    public static final native void resetGlobalStats();
+
+    /**
+     * load a config file into a native document, 0 on failure;
+     * release it with {@link #closeDocument(long)}
+     */
+    public static final native long openDocument(String fileName);
+
+    /**
+     * like {@link #openDocument(String)}, but fails to load a file of more than
+     * maxNodes nodes, aliases counted as the nodes they repeat; 0 means unlimited
+     */
+    public static final native long openDocument(String fileName, long maxNodes);
+
+    /**
+     * snapshot of the runtime counters of one document, indexed by the STAT_* constants
+     */
+    public static final native long[] getDocumentStats(long document);
+
+    public static final native void closeDocument(long document);
 }